@@ -0,0 +1,286 @@
+#include "aggregates.h"
+#include "memory_size.h"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+using namespace std;
+
+
+void Aggregates::clear() {
+    fill(hot.begin(), hot.end(), HotEntry());
+    hotLookups = hotHits = runRows = 0;
+    table.clear();
+    totals.clear();
+    slotRows.clear();
+    rowZone.clear();
+    slotHigh.clear();
+    dayColumns.clear();
+}
+
+
+void Aggregates::reserve(size_t zones) {
+    table.reserve(zones);
+    totals.reserve(zones);
+    slotRows.reserve(zones);
+    dayColumns.reserve(zones);
+}
+
+
+uint32_t Aggregates::zoneId(const ZoneKey& zone, uint64_t hash) {
+    bool added;
+    const uint32_t id = table.insert(zone, hash, added);
+    if (added) {
+        totals.push_back(0);
+        slotRows.emplace_back();
+        dayColumns.emplace_back();
+    }
+    return id;
+}
+
+
+void Aggregates::addSparse(uint32_t z, int slot, uint64_t n) {
+    if (n == 0)
+        return;
+    SlotRow& r = slotRows[z];
+    for (int i = 0; i < SlotRow::kSparse; ++i) {
+        if (r.count[i] != 0 && r.slot[i] != slot)
+            continue;
+        const uint64_t v = r.count[i] + n;        // a zero count is a free entry
+        if (v >> 32)
+            break;
+        r.slot[i] = (uint16_t)slot;
+        r.count[i] = (uint32_t)v;
+        return;
+    }
+    makeDense(z);
+    addSlot(z, slot, n);
+}
+
+
+uint32_t* Aggregates::newRow(uint32_t z) {
+    const uint32_t r = (uint32_t)rowZone.size();
+    if (r / kRowsPerBlock == rowBlocks.size())
+        rowBlocks.emplace_back(new uint32_t[(size_t)kRowsPerBlock * slotsPerZone]);
+    uint32_t* row = denseRow(r);
+    fill(row, row + slotsPerZone, 0);
+    rowZone.push_back(z);
+    slotRows[z].dense = r;
+    return row;
+}
+
+
+void Aggregates::makeDense(uint32_t z) {
+    uint32_t* row = newRow(z);
+    SlotRow& r = slotRows[z];
+    for (int i = 0; i < SlotRow::kSparse && r.count[i] != 0; ++i) {
+        row[r.slot[i]] = r.count[i];
+        r.count[i] = 0;
+    }
+}
+
+
+void Aggregates::carrySlot(uint32_t z, int slot, uint64_t high) {
+    vector<uint32_t>& row = slotHigh[z];
+    if (row.empty())
+        row.assign(slotsPerZone, 0);
+    row[slot] += (uint32_t)high;
+}
+
+
+void Aggregates::slots(uint32_t z, long long* row) const {
+    const SlotRow& r = slotRows[z];
+    if (r.isSparse()) {
+        fill(row, row + slotsPerZone, 0);
+        for (int i = 0; i < SlotRow::kSparse && r.count[i] != 0; ++i)
+            row[r.slot[i]] = r.count[i];
+        return;
+    }
+
+    const uint32_t* low = denseRow(r.dense);
+    for (int s = 0; s < slotsPerZone; ++s)
+        row[s] = low[s];
+    if (slotHigh.empty())
+        return;
+    const auto it = slotHigh.find(z);
+    if (it != slotHigh.end())
+        for (int s = 0; s < slotsPerZone; ++s)
+            row[s] += (long long)it->second[s] << 32;
+}
+
+
+// Events go in batches of kBatch, in four passes, so that the cache misses
+// of a batch overlap instead of queueing one behind the other:
+//  1. settle what needs no table: a zone repeating the previous event's
+//     bytes (clustered exports; the parser has already folded rows with the
+//     same slot and day into one event) or one in the hot-key cache; hash
+//     the rest and prefetch their home slots;
+//  2. look those up in the table, now mostly cached, and prefetch what
+//     every event will touch: its zone's slot row and day column;
+//  3. prefetch the counters of the zones with dense slot rows;
+//  4. count.
+void Aggregates::add(const RowEvent* b, const RowEvent* e) {
+    static const int kBatch = 32;
+    static const uint32_t kPending = UINT32_MAX, kSame = UINT32_MAX - 1;
+    uint32_t ids[kBatch];
+    uint64_t hashes[kBatch];
+    ZoneKey keys[kBatch];
+    HotEntry* entries[kBatch];
+
+    string_view prev;
+    uint32_t prevId = 0;
+    for (const RowEvent* batch = b; batch != e; ) {
+        const int n = (int)min<ptrdiff_t>(kBatch, e - batch);
+
+        for (int i = 0; i < n; ++i) {
+            const string_view zone = batch[i].zone;
+            if ((batch != b || i > 0) && zone.size() == prev.size() &&
+                memcmp(zone.data(), prev.data(), prev.size()) == 0) {
+                ids[i] = kSame;
+                runRows += batch[i].count;
+                continue;
+            }
+            prev = zone;
+            ++hotLookups;
+            runRows += batch[i].count - 1;
+            ids[i] = kPending;
+            entries[i] = nullptr;
+            const ZoneKey& k = keys[i] = ZoneKey::of(zone);
+            if (k.isInline()) {
+                const HotEntry& h = *(entries[i] = &hotEntry(k));
+                if (h.id && h.lo == k.lo && h.hi == k.hi && h.len == k.len) {
+                    ++hotHits;
+                    ids[i] = h.id - 1;
+                    continue;
+                }
+            }
+            hashes[i] = table.hash(k);
+            table.prefetch(hashes[i]);
+        }
+
+        for (int i = 0; i < n; ++i) {
+            if (ids[i] == kSame) {
+                ids[i] = prevId;
+                continue;
+            }
+            if (ids[i] == kPending) {
+                ids[i] = zoneId(keys[i], hashes[i]);
+                if (entries[i])
+                    *entries[i] = {keys[i].lo, keys[i].hi, keys[i].len, ids[i] + 1};
+            }
+            prevId = ids[i];
+            __builtin_prefetch(&slotRows[ids[i]], 1);
+            __builtin_prefetch(&dayColumns[ids[i]]);
+        }
+
+        for (int i = 0; i < n; ++i) {
+            const SlotRow& r = slotRows[ids[i]];
+            if (!r.isSparse())
+                __builtin_prefetch(denseRow(r.dense) + batch[i].slot, 1);
+        }
+
+        for (int i = 0; i < n; ++i) {
+            const RowEvent& ev = batch[i];
+            const uint32_t z = ids[i];
+            totals[z] += ev.count;
+            addSlot(z, ev.slot, ev.count);
+            dayColumns[z].add(ev.day, ev.count);
+        }
+        batch += n;
+    }
+}
+
+
+void Aggregates::mergeFrom(const Aggregates& other) {
+    hotLookups += other.hotLookups;
+    hotHits += other.hotHits;
+    runRows += other.runRows;
+    vector<long long> from(slotsPerZone);
+    for (uint32_t oz = 0; oz < other.zones(); ++oz)
+        mergeZone(zoneId(other.table.packed(oz)), other, oz, from);
+}
+
+
+void Aggregates::mergeZone(uint32_t z, const Aggregates& other, uint32_t oz, vector<long long>& from) {
+    totals[z] += other.totals[oz];
+
+    const SlotRow& r = other.slotRows[oz];
+    if (r.isSparse()) {
+        for (int i = 0; i < SlotRow::kSparse && r.count[i] != 0; ++i)
+            addSlot(z, r.slot[i], r.count[i]);
+    } else {
+        from.resize(slotsPerZone);
+        other.slots(oz, from.data());
+        for (int s = 0; s < slotsPerZone; ++s)
+            if (from[s] != 0)
+                addSlot(z, s, from[s]);
+    }
+
+    dayColumns[z].merge(other.dayColumns[oz]);
+}
+
+
+void Aggregates::absorb(Aggregates&& other) {
+    const size_t need = zones() + other.zones();
+    if (need > totals.capacity())
+        reserve(max(need, totals.capacity() * 2));
+    vector<long long> from;
+    for (uint32_t oz = 0; oz < other.zones(); ++oz) {
+        bool added;
+        const uint32_t z = table.insert(other.table.packed(oz), added);
+        if (!added) {
+            mergeZone(z, other, oz, from);
+            continue;
+        }
+        totals.push_back(other.totals[oz]);
+        SlotRow r = other.slotRows[oz];
+        r.dense = SlotRow::kNoRow;
+        slotRows.push_back(r);
+        if (!other.slotRows[oz].isSparse())
+            memcpy(newRow(z), other.denseRow(other.slotRows[oz].dense), slotsPerZone * sizeof(uint32_t));
+        if (!other.slotHigh.empty()) {
+            auto high = other.slotHigh.find(oz);
+            if (high != other.slotHigh.end())
+                slotHigh[z] = move(high->second);
+        }
+        dayColumns.push_back(move(other.dayColumns[oz]));
+    }
+    hotLookups += other.hotLookups;
+    hotHits += other.hotHits;
+    runRows += other.runRows;
+    other.clear();
+}
+
+
+bool Aggregates::find(string_view zone, uint32_t& z) const {
+    return table.find(zone, z);
+}
+
+
+void Aggregates::tableStats(IngestStats& st) const {
+    st.zones = table.size();
+    st.buckets = table.capacity();
+    st.loadFactor = table.capacity() ? (double)table.size() / table.capacity() : 0;
+    table.probeStats(st.avgProbe, st.maxProbe);
+    st.hotLookups = hotLookups;
+    st.hotHits = hotHits;
+    st.runRows = runRows;
+}
+
+
+void Aggregates::memoryUsage(MemoryUsage& mu) const {
+    mu.zoneDictionary = table.bytes();
+
+    mu.zoneCounters = vectorBytes(totals);
+    mu.slotCounters = vectorBytes(slotRows) + vectorBytes(rowBlocks) + vectorBytes(rowZone) +
+                      rowBlocks.size() * kRowsPerBlock * slotsPerZone * sizeof(uint32_t);
+    if (!slotHigh.empty())
+        mu.slotCounters += hashTableBytes(slotHigh);
+    for (const auto& high : slotHigh)
+        mu.slotCounters += vectorBytes(high.second);
+
+    size_t days = vectorBytes(dayColumns);
+    for (const DayColumn& col : dayColumns)
+        days += col.bytes();
+    mu.dayIndex = days;
+}
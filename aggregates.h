@@ -0,0 +1,159 @@
+#pragma once
+#include "analyzer.h"
+#include "day_series.h"
+#include "zone_table.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Parsed rows waiting for aggregation: `count` consecutive rows with the
+// same zone, slot and day. The zone views the read buffer.
+struct RowEvent {
+    std::string_view zone;
+    uint16_t slot;      // weekday * bucketsPerDay + bucket
+    DayCode day;
+    uint32_t count = 1;
+};
+
+// Everything an ingest counts, for the analyzer itself or for one worker of
+// a parallel ingest. Zones get dense ids in first-seen order and every
+// counter is an array indexed by them.
+class Aggregates {
+public:
+    // A zone's slot counters while it has been seen in at most kSparse
+    // slots, as (slot, count) pairs in first-seen order; a count of 0 ends
+    // the list. Past that the zone gets a dense row.
+    struct SlotRow {
+        static const int kSparse = 4;
+        static const uint32_t kNoRow = UINT32_MAX;
+
+        uint32_t dense = kNoRow;          // index of the dense row
+        uint16_t slot[kSparse] = {};
+        uint32_t count[kSparse] = {};
+
+        bool isSparse() const { return dense == kNoRow; }
+    };
+
+    explicit Aggregates(int slotsPerZone) : slotsPerZone(slotsPerZone) {}
+
+    void clear();
+
+    // Room for this many zones in the table and every per-zone array.
+    void reserve(size_t zones);
+
+    void add(const RowEvent* b, const RowEvent* e);
+    void add(const std::vector<RowEvent>& events) { add(events.data(), events.data() + events.size()); }
+
+    // Adds another worker's counts into these.
+    void mergeFrom(const Aggregates& other);
+
+    // Takes over other's zones, leaving it empty. Meant for zones that are
+    // new here, whose ids are appended and counters moved rather than added;
+    // a zone already here is added as mergeFrom would.
+    void absorb(Aggregates&& other);
+
+    uint32_t zones() const { return (uint32_t)table.size(); }
+    std::string name(uint32_t z) const { return table.key(z); }
+    // name(a) < name(b), on the packed keys.
+    bool nameBefore(uint32_t a, uint32_t b) const { return table.packed(a) < table.packed(b); }
+    long long total(uint32_t z) const { return totals[z]; }
+    // The slotsPerZone exact counts of zone z into row.
+    void slots(uint32_t z, long long* row) const;
+    const SlotRow& slotRow(uint32_t z) const { return slotRows[z]; }
+    // Dense rows, in the order they were made, and whose each is.
+    uint32_t denseRows() const { return (uint32_t)rowZone.size(); }
+    uint32_t denseZone(uint32_t r) const { return rowZone[r]; }
+    // Dense row r's 32-bit counters, or null if one of them has wrapped
+    // (slots() has the exact counts).
+    const uint32_t* narrowRow(uint32_t r) const {
+        if (!slotHigh.empty() && slotHigh.count(rowZone[r]))
+            return nullptr;
+        return denseRow(r);
+    }
+    const DayColumn& days(uint32_t z) const { return dayColumns[z]; }
+
+    bool find(std::string_view zone, uint32_t& z) const;
+
+    size_t rehashes() const { return table.rehashes(); }
+    uint64_t hashSeed() const { return table.hashSeed(); }
+
+    // Fills the zone-table fields of st: size, load, probe lengths and the
+    // hot-key cache counts (including those of merged or absorbed tables).
+    void tableStats(IngestStats& st) const;
+
+    // Fills every MemoryUsage field but filter, total and bytesPerZone.
+    void memoryUsage(MemoryUsage& mu) const;
+
+private:
+    int slotsPerZone;
+
+    ZoneTable table;
+    std::vector<long long> totals;
+    // Most zones of a high-cardinality file turn up in a slot or two, so
+    // every zone starts sparse in slotRows and only those seen in more
+    // slots get a dense row: slotsPerZone counters laid out
+    // [weekday][bucket]. Dense rows are handed out in blocks of
+    // kRowsPerBlock that never move, so making one copies nothing, and
+    // rowZone maps them back for scans in row order. Counters are 32 bits,
+    // 16 to a cache line; the first time one of a zone's wraps, the zone
+    // goes dense if it was not and gets a row of upper halves in slotHigh.
+    static const uint32_t kRowsPerBlock = 64;
+    std::vector<SlotRow> slotRows;
+    std::vector<std::unique_ptr<uint32_t[]>> rowBlocks;    // kept by clear()
+    std::vector<uint32_t> rowZone;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> slotHigh;
+
+    uint32_t* denseRow(uint32_t r) const {
+        return rowBlocks[r / kRowsPerBlock].get() + (size_t)(r % kRowsPerBlock) * slotsPerZone;
+    }
+    // A zeroed dense row for zone z, which must be sparse.
+    uint32_t* newRow(uint32_t z);
+    // Adds other's zone oz into zone z; from is scratch for a dense row.
+    void mergeZone(uint32_t z, const Aggregates& other, uint32_t oz, std::vector<long long>& from);
+    std::vector<DayColumn> dayColumns;
+
+    // Direct-mapped cache of recently counted zones in front of the table.
+    // It holds inline keys (up to 16 bytes) as their two words and length,
+    // so a hit on a skewed zone is three compares and no hashing, probing
+    // or trip to the table.
+    struct HotEntry {
+        uint64_t lo = 0, hi = 0;
+        uint32_t len = 0;
+        uint32_t id = 0;                  // id + 1; 0 = empty
+    };
+    static const int kHotBits = 8;
+    std::vector<HotEntry> hot = std::vector<HotEntry>(1 << kHotBits);
+    long long hotLookups = 0, hotHits = 0;
+    long long runRows = 0;
+
+    // Adds n to a slot counter, carrying into slotHigh when it wraps.
+    void addSlot(uint32_t z, int slot, uint64_t n) {
+        SlotRow& r = slotRows[z];
+        if (r.isSparse()) {
+            addSparse(z, slot, n);
+            return;
+        }
+        uint32_t& c = denseRow(r.dense)[slot];
+        const uint64_t v = c + n;
+        c = (uint32_t)v;
+        if (v >> 32)
+            carrySlot(z, slot, v >> 32);
+    }
+    void addSparse(uint32_t z, int slot, uint64_t n);
+    void carrySlot(uint32_t z, int slot, uint64_t high);
+    // Gives zone z a dense row holding its sparse counts.
+    void makeDense(uint32_t z);
+
+    uint32_t zoneId(const ZoneKey& zone) { return zoneId(zone, table.hash(zone)); }
+    uint32_t zoneId(const ZoneKey& zone, uint64_t hash);
+
+    // The cache entry for an inline key.
+    HotEntry& hotEntry(const ZoneKey& zone) {
+        // seeded like the table, so crafted IDs can't all share one entry
+        return hot[hashMix(zone.lo ^ table.hashSeed(), zone.hi ^ zone.len ^ 0xe7037ed1a0b428dbull) >> (64 - kHotBits)];
+    }
+};
@@ -1,149 +1,1147 @@
-#include "analyzer.h"
-#include <fstream>
-#include <sstream>
-#include <unordered_map>
-#include <queue>
-#include <vector>
-#include <cctype>
-
-using namespace std;
-
-
-static unordered_map<string, long long> zoneCounts;
-static unordered_map<string, long long> slotCounts;
-
-
-static inline void trim(string& s) {
-    size_t start = 0;
-    while (start < s.size() && isspace(s[start])) start++;
-
-    size_t end = s.size();
-    while (end > start && isspace(s[end - 1])) end--;
-
-    s = s.substr(start, end - start);
-}
-
-
-void TripAnalyzer::ingestFile(const string& csvPath) {
-    zoneCounts.clear();
-    slotCounts.clear();
-
-
-    zoneCounts.reserve(100000);
-    slotCounts.reserve(100000);
-
-    ifstream file(csvPath, ios::in);
-    if (!file.is_open())
-        return;
-
-    string line;
-    bool firstLine = true;
-
-    while (getline(file, line)) {
-        if (line.empty())
-            continue;
-
-        if (line.back() == '\r')
-            line.pop_back();
-
-      
-        if (firstLine) {
-            firstLine = false;
-            if (line.find("TripID") != string::npos)
-                continue;
-        }
-
-        string tripID, pickupZone, dropoffZone, datetime;
-        string distance, fare;
-
-        stringstream ss(line);
-        if (!getline(ss, tripID, ',')) continue;
-        if (!getline(ss, pickupZone, ',')) continue;
-        if (!getline(ss, dropoffZone, ',')) continue;
-        if (!getline(ss, datetime, ',')) continue;
-        if (!getline(ss, distance, ',')) continue;
-        if (!getline(ss, fare, ',')) continue;
-
-        trim(pickupZone);
-        trim(datetime);
-
-        if (datetime.size() < 5)
-            continue;
-
-        int hour;
-        try {
-            hour = stoi(datetime.substr(datetime.size() - 5, 2));
-        } catch (...) {
-            continue;
-        }
-
-        if (hour < 0 || hour > 23)
-            continue;
-
-        ++zoneCounts[pickupZone];
-        ++slotCounts[pickupZone + "#" + to_string(hour)];
-    }
-
-    file.close();
-}
-
-
-vector<ZoneCount> TripAnalyzer::topZones(int k) const {
-    auto cmp = [](const ZoneCount& a, const ZoneCount& b) {
-        if (a.count != b.count)
-            return a.count > b.count;   
-        return a.zone < b.zone;
-    };
-
-    priority_queue<ZoneCount, vector<ZoneCount>, decltype(cmp)> heap(cmp);
-
-    for (const auto& z : zoneCounts) {
-        heap.push({z.first, z.second});
-        if ((int)heap.size() > k)
-            heap.pop();
-    }
-
-    vector<ZoneCount> result(heap.size());
-    for (int i = (int)heap.size() - 1; i >= 0; --i) {
-        result[i] = heap.top();
-        heap.pop();
-    }
-
-    return result;
-}
-
-
-vector<SlotCount> TripAnalyzer::topBusySlots(int k) const {
-    auto cmp = [](const SlotCount& a, const SlotCount& b) {
-        if (a.count != b.count)
-            return a.count > b.count;
-        if (a.zone != b.zone)
-            return a.zone < b.zone;
-        return a.hour < b.hour;
-    };
-
-    priority_queue<SlotCount, vector<SlotCount>, decltype(cmp)> heap(cmp);
-
-    for (const auto& s : slotCounts) {
-        size_t pos = s.first.find('#');
-        if (pos == string::npos)
-            continue;
-
-        SlotCount sc;
-        sc.zone = s.first.substr(0, pos);
-        sc.hour = stoi(s.first.substr(pos + 1));
-        sc.count = s.second;
-
-        heap.push(sc);
-        if ((int)heap.size() > k)
-            heap.pop();
-    }
-
-    vector<SlotCount> result(heap.size());
-    for (int i = (int)heap.size() - 1; i >= 0; --i) {
-        result[i] = heap.top();
-        heap.pop();
-    }
-
-    return result;
-}
+#include "analyzer.h"
+#include "aggregates.h"
+#include "block_reader.h"
+#include "byte_arena.h"
+#include "cardinality.h"
+#include "day_series.h"
+#include "ingest_filter.h"
+#include "ring_buffer.h"
+#include "trace.h"
+#include "trip_parse.h"
+#include "work_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <fstream>
+#include <queue>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+
+
+static const int kHours = 24;
+static const int kWeekdays = 7;
+// Slot rows per zone: one per weekday, then one for rows whose date didn't
+// parse, which count towards the hour rankings but no weekday.
+static const int kSlotWeekdays = kWeekdays + 1;
+static const int kMinutesPerDay = kHours * 60;
+
+// A parallel ingest hands out the file in line-aligned pieces of about this size.
+static const uint64_t kMorselBytes = 1 << 20;
+
+// A partitioned ingest scatters rows into this many partitions per thread,
+// so counting them can be balanced by stealing.
+static const int kPartitionsPerThread = 4;
+
+// A pipelined ingest reads blocks of about this size (grown for longer lines).
+static const size_t kPipeBlockBytes = 1 << 20;
+
+// Read ahead of the main pass to size the zone tables.
+static const size_t kSampleBytes = 4 << 20;
+
+
+struct PhaseObserver {
+    PhaseHook hook = nullptr;
+    void* ctx = nullptr;
+};
+
+
+static void addTime(double& totalMs, chrono::steady_clock::duration d) {
+    totalMs += chrono::duration<double, milli>(d).count();
+}
+
+// A total that const queries on several threads add to.
+static void addTime(atomic<long long>& totalNs, chrono::steady_clock::duration d) {
+    totalNs.fetch_add(chrono::duration_cast<chrono::nanoseconds>(d).count(), memory_order_relaxed);
+}
+
+// Adds the time until destruction to a total (addTime), and reports the
+// phase to an observer outside the timed span.
+template <class Total>
+class PhaseTimer {
+public:
+    explicit PhaseTimer(Total& total, PhaseObserver obs = PhaseObserver(), const char* phase = "")
+        : total(total), obs(obs), phase(phase) {
+        if (obs.hook)
+            obs.hook(obs.ctx, phase, true);
+        t0 = chrono::steady_clock::now();
+    }
+    ~PhaseTimer() {
+        addTime(total, chrono::steady_clock::now() - t0);
+        if (obs.hook)
+            obs.hook(obs.ctx, phase, false);
+    }
+
+private:
+    Total& total;
+    PhaseObserver obs;
+    const char* phase;
+    chrono::steady_clock::time_point t0;
+};
+
+
+// A ranking candidate: one slot of one zone.
+struct SlotRef {
+    long long count;
+    uint32_t zone;
+    int slot;
+};
+
+
+struct TripAnalyzer::Impl {
+    int minutesPerBucket;
+    int bucketsPerDay;
+    int slotsPerZone;               // kSlotWeekdays * bucketsPerDay
+
+    Aggregates agg;
+
+    unique_ptr<RowFilter> filter{new RowFilter};
+    IngestOptions options;
+    PhaseObserver observer;
+    vector<RowEvent> events;
+
+    IngestStats stats;                      // rankMs aside
+    mutable atomic<long long> rankNs{0};    // queries may run concurrently
+
+    explicit Impl(int minutes)
+        : minutesPerBucket(minutes),
+          bucketsPerDay(kMinutesPerDay / minutes),
+          slotsPerZone(kSlotWeekdays * bucketsPerDay),
+          agg(slotsPerZone) {}
+
+    void clear() {
+        stats = IngestStats();
+        rankNs = 0;
+        agg.clear();
+    }
+
+    template <int BucketsPerDay>
+    void ingestParallel(istream& file, const string& path, uint64_t size, int threads,
+                        const CardinalityEstimate& est);
+
+    template <int BucketsPerDay>
+    void ingestPartitioned(const string& path, const vector<uint64_t>& cuts, int threads,
+                           const CardinalityEstimate& est);
+
+    template <int BucketsPerDay>
+    void ingestPipeline(const string& path, int threads, const CardinalityEstimate& est);
+
+    template <int BucketsPerDay>
+    vector<SlotRef> topSlotRefs(int k, bool byWeekday) const;
+};
+
+
+// Calls f with the bucket count as a compile-time constant, so the slot
+// loops are fully specialised for each supported granularity.
+template <class F>
+static decltype(auto) dispatchBuckets(int bucketsPerDay, F&& f) {
+    switch (bucketsPerDay) {
+    case 288: return f(integral_constant<int, 288>());
+    case 96:  return f(integral_constant<int, 96>());
+    case 48:  return f(integral_constant<int, 48>());
+    default:  return f(integral_constant<int, 24>());
+    }
+}
+
+
+static int checkedBucketMinutes(int minutes) {
+    if (minutes != 5 && minutes != 15 && minutes != 30 && minutes != 60)
+        throw invalid_argument("TripAnalyzer: bucket size must be 5, 15, 30 or 60 minutes");
+    return minutes;
+}
+
+
+TripAnalyzer::TripAnalyzer(int minutesPerBucket)
+    : impl(new Impl(checkedBucketMinutes(minutesPerBucket))) {}
+TripAnalyzer::~TripAnalyzer() = default;
+TripAnalyzer::TripAnalyzer(TripAnalyzer&&) noexcept = default;
+TripAnalyzer& TripAnalyzer::operator=(TripAnalyzer&&) noexcept = default;
+
+
+// A query bound must be exactly YYYY-MM-DD.
+static DayCode checkedDay(const string& date) {
+    DayCode day;
+    if (date.size() != 10 || !parseDay(date, day))
+        throw invalid_argument("TripAnalyzer: expected a YYYY-MM-DD date, got '" + date + "'");
+    return day;
+}
+
+
+static void checkFilter(const IngestFilter& f) {
+    if (!f.fromDate.empty())
+        checkedDay(f.fromDate);
+    if (!f.toDate.empty())
+        checkedDay(f.toDate);
+    if (f.fromHour < 0 || f.fromHour > 23 || f.toHour < 0 || f.toHour > 23)
+        throw invalid_argument("TripAnalyzer: filter hours must be within 0-23");
+}
+
+
+// One zone per line; blank lines and lines starting with '#' are skipped.
+static vector<string> readZoneList(const string& path) {
+    ifstream file(path, ios::in | ios::binary);
+    if (!file.is_open())
+        throw runtime_error("TripAnalyzer: cannot open zone list '" + path + "'");
+
+    vector<string> zones;
+    LineReader reader(file);
+    const char *b, *e;
+    while (reader.next(b, e)) {
+        const string_view zone = trimmed(b, e);
+        if (!zone.empty() && zone[0] != '#')
+            zones.emplace_back(zone);
+    }
+    return zones;
+}
+
+
+void TripAnalyzer::setIngestFilter(const IngestFilter& filter) {
+    checkFilter(filter);
+    vector<string> fileZones;
+    if (!filter.allowZonesFile.empty())
+        fileZones = readZoneList(filter.allowZonesFile);
+    impl->filter.reset(new RowFilter(filter, fileZones));
+}
+
+
+void TripAnalyzer::setPhaseHook(PhaseHook hook, void* ctx) {
+    impl->observer.hook = hook;
+    impl->observer.ctx = ctx;
+}
+
+
+void TripAnalyzer::setIngestOptions(const IngestOptions& options) {
+    if (options.threads < 0)
+        throw invalid_argument("TripAnalyzer: thread count must not be negative");
+    impl->options = options;
+}
+
+
+template <int BucketsPerDay>
+static void parseBlock(const char* b, const char* e, bool& header, const RowFilter& filter,
+                       vector<RowEvent>& events, IngestStats& st) {
+    constexpr int kMinutesPerBucket = kMinutesPerDay / BucketsPerDay;
+
+    events.clear();
+    forEachLine(b, e, [&](const char* lb, const char* le) {
+        if (lb == le)
+            return;
+
+        if (header) {
+            header = false;
+            if (string_view(lb, le - lb).find("TripID") != string_view::npos)
+                return;
+        }
+        ++st.rowsSeen;
+
+        RawRow row;
+        if (!splitRow(lb, le, row)) {
+            ++st.rejectedMissingColumn;
+            return;
+        }
+        if (row.zone.empty()) {
+            ++st.rejectedEmptyZone;
+            return;
+        }
+
+        // filters first: they only compare bytes
+        if (!filter.acceptTimestamp(row.timestamp) || !filter.acceptZone(row.zone)) {
+            ++st.rowsFiltered;
+            return;
+        }
+
+        Timestamp ts;
+        switch (parseTimestamp(row.timestamp, ts)) {
+        case RowError::None:
+            break;
+        case RowError::BadHour:
+            ++st.rejectedBadHour;
+            return;
+        default:
+            ++st.rejectedBadTimestamp;
+            return;
+        }
+
+        const int bucket = (ts.hour * 60 + ts.minute) / kMinutesPerBucket;
+        const int weekday = ts.dated ? weekdayFromDays(ts.days) : kWeekdays;
+        const uint16_t slot = (uint16_t)(weekday * BucketsPerDay + bucket);
+        ++st.rowsAccepted;
+        if (!ts.dated)
+            ++st.rowsUndated;
+
+        // a run of rows with the same zone, day and slot becomes one event
+        if (!events.empty()) {
+            RowEvent& last = events.back();
+            if (last.slot == slot && last.day == ts.day && last.zone == row.zone) {
+                ++last.count;
+                return;
+            }
+        }
+        events.push_back({row.zone, slot, ts.day});
+    });
+}
+
+
+// Counts the rows the reader hands out. Blocks of lines are parsed into a
+// batch of row events, then the batch goes to sink (the aggregate phase),
+// which keeps the phases apart for timing.
+template <int BucketsPerDay, class Sink>
+static void ingestRange(LineReader& reader, bool header, const RowFilter& filter,
+                        const PhaseObserver& obs, vector<RowEvent>& events, IngestStats& st,
+                        Sink&& sink) {
+    const char *b, *e;
+
+    while (reader.nextBlock(b, e)) {
+        {
+            TraceScope trace("parse block", "ingest");
+            trace.setArg("bytes", e - b);
+            PhaseTimer t(st.parseMs, obs, "parse");
+            parseBlock<BucketsPerDay>(b, e, header, filter, events, st);
+        }
+        TraceScope trace("aggregate block", "ingest");
+        trace.setArg("rows", events.size());
+        PhaseTimer t(st.aggregateMs, obs, "aggregate");
+        sink(events);
+    }
+}
+
+
+// Offsets 0 = c[0] < ... < c[n] = size where every c[i] starts a line, for
+// n morsels of roughly equal size (fewer if lines are longer than a morsel).
+static vector<uint64_t> lineAlignedCuts(istream& in, uint64_t size, int n) {
+    vector<uint64_t> cuts{0};
+    for (int i = 1; i < n; ++i) {
+        uint64_t pos = size * i / n;
+        if (pos <= cuts.back())
+            continue;
+
+        in.clear();
+        in.seekg(pos - 1);
+        char c;
+        while (in.get(c) && c != '\n')
+            ++pos;
+        if (pos >= size)
+            break;
+        cuts.push_back(pos);
+    }
+    cuts.push_back(size);
+    in.clear();
+    return cuts;
+}
+
+
+static void addCounts(IngestStats& to, const IngestStats& from) {
+    to.bytesRead += from.bytesRead;
+    to.rowsSeen += from.rowsSeen;
+    to.rowsAccepted += from.rowsAccepted;
+    to.rowsUndated += from.rowsUndated;
+    to.rowsFiltered += from.rowsFiltered;
+    to.rejectedMissingColumn += from.rejectedMissingColumn;
+    to.rejectedEmptyZone += from.rejectedEmptyZone;
+    to.rejectedBadTimestamp += from.rejectedBadTimestamp;
+    to.rejectedBadHour += from.rejectedBadHour;
+    to.ioMs += from.ioMs;
+    to.parseMs += from.parseMs;
+    to.aggregateMs += from.aggregateMs;
+}
+
+
+// Distinct zones among the rows the filter accepts, extrapolated from the
+// first kSampleBytes of the file; leaves the file rewound.
+static CardinalityEstimate sampleZones(istream& file, uint64_t size, const RowFilter& filter) {
+    HyperLogLog firstHalf, all;
+    double rows = 0, halfRows = 0;
+    uint64_t consumed = 0;
+
+    LineReader reader(file, 1 << 20, kSampleBytes);
+    const char *b, *e;
+    bool header = true;
+    while (reader.nextBlock(b, e)) {
+        forEachLine(b, e, [&](const char* lb, const char* le) {
+            if (lb == le)
+                return;
+            if (header) {
+                header = false;
+                if (string_view(lb, le - lb).find("TripID") != string_view::npos)
+                    return;
+            }
+            RawRow row;
+            if (!splitRow(lb, le, row) || row.zone.empty() ||
+                !filter.acceptTimestamp(row.timestamp) || !filter.acceptZone(row.zone))
+                return;
+
+            const uint64_t h = hashBytes(row.zone.data(), row.zone.size(), 0x5a4d504c);
+            all.add(h);
+            ++rows;
+            if (consumed + (lb - b) < kSampleBytes / 2) {
+                firstHalf.add(h);
+                ++halfRows;
+            }
+        });
+        consumed += e - b;
+    }
+    file.clear();
+    file.seekg(0);
+
+    CardinalityEstimate est;
+    est.sampledRows = rows;
+    est.sampledZones = min(all.estimate(), rows);
+    est.totalRows = consumed >= size || consumed == 0 ? rows : rows * ((double)size / consumed);
+    if (halfRows > 0 && rows > halfRows) {
+        const double halfZones = min(firstHalf.estimate(), halfRows);
+        est.alpha = log(est.sampledZones / max(halfZones, 1.0)) / log(rows / halfRows);
+        est.alpha = min(max(est.alpha, 0.0), 1.0);
+    }
+    est.fitPopulation();
+    return est;
+}
+
+
+// Reserve a little over an estimate: the sketch is off by a few percent.
+static size_t withSlack(double zones) {
+    return (size_t)(zones * 1.125) + 16;
+}
+
+
+// Rows of one zone partition scattered by one worker; the zones view names.
+struct PartitionBuffer {
+    ByteArena names;
+    vector<RowEvent> events;
+};
+
+
+// The file could be opened for sizing but not again by a worker or the
+// pipeline reader (deleted or replaced in between). ingestFile then counts
+// nothing, as when it can't open the file at all.
+struct FileVanished : runtime_error {
+    explicit FileVanished(const string& path) : runtime_error("TripAnalyzer: cannot reopen '" + path + "'") {}
+};
+
+
+// One thread of a parallel ingest: its own stream, reader and counts.
+struct IngestWorker {
+    ifstream in;
+    LineReader reader{in};
+    unique_ptr<Aggregates> agg;     // PerThread; null for worker 0, which counts into the analyzer's
+    vector<PartitionBuffer> partitions;     // Partitioned
+    vector<RowEvent> events;
+    IngestStats stats;
+
+    // Positions the reader on morsel [from, to) of path.
+    void seek(const string& path, uint64_t from, uint64_t to) {
+        if (!in.is_open()) {
+            in.open(path, ios::in | ios::binary);
+            if (!in.is_open())
+                throw FileVanished(path);
+        }
+        in.clear();
+        in.seekg(from);
+        reader.restart(to - from);
+    }
+};
+
+
+// Seed of zonePartition. Every thread that scatters must agree, so it comes
+// from the analyzer's table, which they all share; it is random like that
+// table's, so crafted zone IDs can't all land in one partition and leave the
+// counting to one thread.
+static uint64_t partitionSeed(const Aggregates& agg) {
+    return hashMix(agg.hashSeed() ^ 0x70617274, 0x9e3779b97f4a7c15ull);
+}
+
+// Partition of a zone among `partitions`.
+static int zonePartition(string_view zone, int partitions, uint64_t seed) {
+    return (int)(hashBytes(zone.data(), zone.size(), seed) % (uint64_t)partitions);
+}
+
+
+// Partitioned beats per-thread tables once merging them costs more than
+// scattering the rows: a merge adds a whole slot row for every zone of
+// every extra table, a scatter copies one row event and its zone bytes,
+// measured at about the cost of this many merged slots.
+static const double kScatterCostInSlots = 2;
+
+static bool preferPartitioned(const CardinalityEstimate& est, int threads, int slotsPerZone) {
+    const double mergedSlots = (threads - 1) * est.zonesIn(est.totalRows / threads) * slotsPerZone;
+    return mergedSlots > kScatterCostInSlots * est.totalRows;
+}
+
+
+// The file is cut into line-aligned morsels that the threads take from a
+// work-stealing pool, so a region of expensive rows keeps every thread busy
+// instead of one. Only morsel 0 can hold the header. With per-thread tables,
+// worker 0 is the calling thread and counts straight into agg; the others
+// count into their own tables, which are merged into it afterwards.
+template <int BucketsPerDay>
+void TripAnalyzer::Impl::ingestParallel(istream& file, const string& path, uint64_t size, int threads,
+                                        const CardinalityEstimate& est) {
+    const vector<uint64_t> cuts = lineAlignedCuts(file, size, (int)max<uint64_t>(size / kMorselBytes, 1));
+    const size_t morsels = cuts.size() - 1;
+    threads = (int)min<size_t>(threads, morsels);
+
+    const bool partitioned = options.aggregation == Aggregation::Partitioned ||
+        (options.aggregation == Aggregation::Auto && preferPartitioned(est, threads, slotsPerZone));
+    if (partitioned) {
+        ingestPartitioned<BucketsPerDay>(path, cuts, threads, est);
+        return;
+    }
+
+    vector<unique_ptr<IngestWorker>> workers;
+    for (int w = 0; w < threads; ++w) {
+        workers.emplace_back(new IngestWorker);
+        if (w > 0) {
+            workers[w]->agg.reset(new Aggregates(slotsPerZone));
+            workers[w]->agg->reserve(withSlack(est.zonesIn(est.totalRows / threads)));
+        }
+    }
+
+    runStealing(threads, morsels, [&](int w, size_t m) {
+        IngestWorker& worker = *workers[w];
+        if (w > 0)
+            traceThreadName("ingest worker");
+        TraceScope trace("morsel", "worker");
+        trace.setArg("bytes", cuts[m + 1] - cuts[m]);
+
+        worker.seek(path, cuts[m], cuts[m + 1]);
+        Aggregates& into = w == 0 ? agg : *worker.agg;
+        ingestRange<BucketsPerDay>(worker.reader, m == 0, *filter, observer,
+                                   w == 0 ? events : worker.events, worker.stats,
+                                   [&](const vector<RowEvent>& batch) { into.add(batch); });
+    });
+
+    for (const auto& worker : workers) {
+        worker->stats.bytesRead = worker->reader.bytesRead();
+        worker->stats.ioMs = worker->reader.readSeconds() * 1000;
+        addCounts(stats, worker->stats);
+        if (worker->agg)
+            stats.rehashes += worker->agg->rehashes();
+    }
+
+    PhaseTimer t(stats.mergeMs, observer, "merge");
+    for (const auto& worker : workers) {
+        if (!worker->agg)
+            continue;
+        TraceScope trace("merge", "merge");
+        trace.setArg("zones", worker->agg->zones());
+        agg.mergeFrom(*worker->agg);
+    }
+}
+
+
+// Two passes over work-stolen pools. First every worker parses morsels and
+// scatters the row events into one buffer per zone partition, copying the
+// zone bytes since the read buffer moves on. Then every partition is counted
+// by one thread from all workers' buffers. A zone lives in exactly one
+// partition, so the partitions' tables are disjoint and are appended to agg
+// instead of merged into it.
+template <int BucketsPerDay>
+void TripAnalyzer::Impl::ingestPartitioned(const string& path, const vector<uint64_t>& cuts, int threads,
+                                           const CardinalityEstimate& est) {
+    const size_t morsels = cuts.size() - 1;
+    const int partitions = threads * kPartitionsPerThread;
+    const uint64_t seed = partitionSeed(agg);
+    stats.partitions = partitions;
+
+    vector<unique_ptr<IngestWorker>> workers;
+    for (int w = 0; w < threads; ++w) {
+        workers.emplace_back(new IngestWorker);
+        workers[w]->partitions.resize(partitions);
+    }
+
+    runStealing(threads, morsels, [&](int w, size_t m) {
+        IngestWorker& worker = *workers[w];
+        if (w > 0)
+            traceThreadName("ingest worker");
+        TraceScope trace("morsel", "worker");
+        trace.setArg("bytes", cuts[m + 1] - cuts[m]);
+
+        worker.seek(path, cuts[m], cuts[m + 1]);
+        ingestRange<BucketsPerDay>(worker.reader, m == 0, *filter, observer, worker.events, worker.stats,
+                                   [&](const vector<RowEvent>& batch) {
+            for (const RowEvent& ev : batch) {
+                PartitionBuffer& to = worker.partitions[zonePartition(ev.zone, partitions, seed)];
+                to.events.push_back({to.names.copy(ev.zone), ev.slot, ev.day, ev.count});
+            }
+        });
+    });
+
+    vector<unique_ptr<Aggregates>> parts(partitions);
+    runStealing(threads, partitions, [&](int w, size_t p) {
+        if (w > 0)
+            traceThreadName("ingest worker");
+        TraceScope trace("partition", "worker");
+        IngestStats& st = workers[w]->stats;
+        PhaseTimer t(st.aggregateMs, observer, "aggregate");
+
+        parts[p].reset(new Aggregates(slotsPerZone));
+        parts[p]->reserve(withSlack(est.zones() / partitions));
+        for (const auto& worker : workers) {
+            parts[p]->add(worker->partitions[p].events);
+            worker->partitions[p] = PartitionBuffer();
+        }
+        trace.setArg("zones", parts[p]->zones());
+    });
+
+    for (const auto& worker : workers) {
+        worker->stats.bytesRead = worker->reader.bytesRead();
+        worker->stats.ioMs = worker->reader.readSeconds() * 1000;
+        addCounts(stats, worker->stats);
+    }
+    for (const auto& part : parts)
+        stats.rehashes += part->rehashes();
+
+    PhaseTimer t(stats.mergeMs, observer, "merge");
+    TraceScope trace("append partitions", "merge");
+    for (auto& part : parts) {
+        agg.absorb(move(*part));
+        part.reset();
+    }
+}
+
+
+// A block of whole lines on its way through the pipeline. Its parser sorts
+// the block's events by partition, so each aggregator gets one contiguous
+// slice of them; the last aggregator done hands the block back for reuse.
+struct PipeBlock {
+    vector<char> bytes;
+    size_t size = 0;
+    uint64_t index = 0;
+    vector<RowEvent> parsed;            // in row order
+    vector<RowEvent> events;            // grouped by partition
+    vector<size_t> starts;              // partition p is events[starts[p], starts[p + 1])
+    atomic<int> pending{0};             // slices not yet counted
+};
+
+// Partition p's share of a block; a null block marks the end of a parser's output.
+struct PipeSlice {
+    PipeBlock* block = nullptr;
+    int partition = 0;
+};
+
+
+
+
+// Reader -> parsers -> aggregators, so reading, parsing and counting
+// overlap. The calling thread reads line-aligned blocks and deals them
+// round-robin to the parsers over SPSC rings; each parser turns a block into
+// row events grouped by zone partition and sends every aggregator its slice
+// over that aggregator's MPSC ring. An aggregator owns the zones of its
+// partition outright: aggregator 0 counts straight into agg and the others'
+// tables are appended to it, not merged. Blocks come from a fixed pool fed
+// back through an MPSC ring, which bounds memory and is the backpressure:
+// the reader waits for a free block when the later stages fall behind.
+template <int BucketsPerDay>
+void TripAnalyzer::Impl::ingestPipeline(const string& path, int threads, const CardinalityEstimate& est) {
+    BlockReader reader(path);
+    if (!reader.isOpen())
+        throw FileVanished(path);
+
+    const int parsers = max(1, threads / 2);
+    const int partitions = max(1, threads - parsers);
+    const uint64_t seed = partitionSeed(agg);
+
+    vector<unique_ptr<PipeBlock>> pool(2 * parsers + 2);
+    MpscRing<PipeBlock*> freeBlocks(pool.size());
+    for (auto& b : pool) {
+        b.reset(new PipeBlock);
+        b->bytes.resize(kPipeBlockBytes);
+        PipeBlock* p = b.get();
+        freeBlocks.tryPush(move(p));
+    }
+
+    vector<unique_ptr<SpscRing<PipeBlock*>>> toParser;
+    for (int i = 0; i < parsers; ++i)
+        toParser.emplace_back(new SpscRing<PipeBlock*>(2));
+    vector<unique_ptr<MpscRing<PipeSlice>>> toAggregator;
+    for (int i = 0; i < partitions; ++i)
+        toAggregator.emplace_back(new MpscRing<PipeSlice>(pool.size() + parsers));
+
+    vector<unique_ptr<Aggregates>> parts;
+    for (int i = 1; i < partitions; ++i) {
+        parts.emplace_back(new Aggregates(slotsPerZone));
+        parts.back()->reserve(withSlack(est.zones() / partitions));
+    }
+
+    atomic<bool> stop{false};
+    vector<exception_ptr> errors(1 + parsers + partitions);
+    vector<IngestStats> stageStats(errors.size());
+    auto guarded = [&](int stage, auto&& body) {
+        try {
+            body(stageStats[stage]);
+        } catch (...) {
+            errors[stage] = current_exception();
+            stop = true;
+        }
+    };
+
+    auto release = [&](PipeBlock* block) {
+        waitFor([&] { return freeBlocks.tryPush(move(block)); }, stop);
+    };
+
+    auto parse = [&](int id) {
+        traceThreadName("ingest parser");
+        guarded(1 + id, [&](IngestStats& st) {
+            vector<int> part;
+            vector<size_t> at;
+            PipeBlock* block;
+            while (waitFor([&] { return toParser[id]->tryPop(block); }, stop) && block) {
+                {
+                    TraceScope trace("parse block", "ingest");
+                    trace.setArg("bytes", block->size);
+                    PhaseTimer t(st.parseMs, observer, "parse");
+                    bool header = block->index == 0;
+                    parseBlock<BucketsPerDay>(block->bytes.data(), block->bytes.data() + block->size,
+                                              header, *filter, block->parsed, st);
+
+                    // counting sort of the events by partition
+                    if (partitions == 1) {
+                        block->starts = {0, block->parsed.size()};
+                        block->events.swap(block->parsed);
+                    } else {
+                        block->starts.assign(partitions + 1, 0);
+                        part.resize(block->parsed.size());
+                        for (size_t i = 0; i < part.size(); ++i) {
+                            part[i] = zonePartition(block->parsed[i].zone, partitions, seed);
+                            ++block->starts[part[i] + 1];
+                        }
+                        for (int p = 0; p < partitions; ++p)
+                            block->starts[p + 1] += block->starts[p];
+                        block->events.resize(block->parsed.size());
+                        at.assign(block->starts.begin(), block->starts.end() - 1);
+                        for (size_t i = 0; i < part.size(); ++i)
+                            block->events[at[part[i]]++] = block->parsed[i];
+                    }
+                }
+
+                int slices = 0;
+                for (int p = 0; p < partitions; ++p)
+                    slices += block->starts[p + 1] > block->starts[p];
+                if (slices == 0) {
+                    release(block);
+                    continue;
+                }
+                block->pending = slices;
+                for (int p = 0; p < partitions; ++p)
+                    if (block->starts[p + 1] > block->starts[p])
+                        waitFor([&] { return toAggregator[p]->tryPush(PipeSlice{block, p}); }, stop);
+            }
+            for (int p = 0; p < partitions; ++p)
+                waitFor([&] { return toAggregator[p]->tryPush(PipeSlice()); }, stop);
+        });
+    };
+
+    auto aggregate = [&](int id) {
+        traceThreadName("ingest aggregator");
+        guarded(1 + parsers + id, [&](IngestStats& st) {
+            Aggregates& into = id == 0 ? agg : *parts[id - 1];
+            int ended = 0;
+            PipeSlice slice;
+            while (ended < parsers && waitFor([&] { return toAggregator[id]->tryPop(slice); }, stop)) {
+                if (!slice.block) {
+                    ++ended;
+                    continue;
+                }
+                PipeBlock* block = slice.block;
+                const RowEvent* b = block->events.data() + block->starts[slice.partition];
+                const RowEvent* e = block->events.data() + block->starts[slice.partition + 1];
+                {
+                    TraceScope trace("aggregate block", "ingest");
+                    trace.setArg("rows", e - b);
+                    PhaseTimer t(st.aggregateMs, observer, "aggregate");
+                    into.add(b, e);
+                }
+                if (block->pending.fetch_sub(1, memory_order_acq_rel) == 1)
+                    release(block);
+            }
+        });
+    };
+
+    vector<thread> stages;
+    for (int i = 0; i < parsers; ++i)
+        stages.emplace_back(parse, i);
+    for (int i = 0; i < partitions; ++i)
+        stages.emplace_back(aggregate, i);
+
+    // The reader: whole lines per block; a partial last line carries over.
+    guarded(0, [&](IngestStats&) {
+        vector<char> carry;
+        uint64_t offset = 0, index = 0;
+        int next = 0;
+        bool eof = false;
+        while (!eof) {
+            PipeBlock* block;
+            if (!waitFor([&] { return freeBlocks.tryPop(block); }, stop))
+                break;
+            TraceScope trace("read block", "io");
+            if (carry.size() >= block->bytes.size())
+                block->bytes.resize(carry.size() * 2);
+            copy(carry.begin(), carry.end(), block->bytes.begin());
+            size_t have = carry.size();
+            size_t lineEnd = 0;
+            for (;;) {
+                if (have == block->bytes.size())
+                    block->bytes.resize(block->bytes.size() * 2);
+                const size_t got = reader.readAt(offset, block->bytes.data() + have, block->bytes.size() - have);
+                offset += got;
+                have += got;
+                if (got == 0) {
+                    eof = true;
+                    lineEnd = have;
+                    break;
+                }
+                const char* last = block->bytes.data() + have;
+                while (last > block->bytes.data() && last[-1] != '\n')
+                    --last;
+                lineEnd = last - block->bytes.data();
+                if (lineEnd > 0)
+                    break;
+            }
+            reader.willNeed(offset, block->bytes.size());
+            trace.setArg("bytes", lineEnd);
+
+            carry.assign(block->bytes.begin() + lineEnd, block->bytes.begin() + have);
+            block->size = lineEnd;
+            block->index = index++;
+            if (lineEnd == 0) {
+                release(block);
+                continue;
+            }
+            waitFor([&] { return toParser[next]->tryPush(move(block)); }, stop);
+            next = (next + 1) % parsers;
+        }
+        for (auto& ring : toParser)
+            waitFor([&] { PipeBlock* end = nullptr; return ring->tryPush(move(end)); }, stop);
+    });
+    stageStats[0].bytesRead = reader.bytesRead();
+    stageStats[0].ioMs = reader.readSeconds() * 1000;
+
+    for (thread& t : stages)
+        t.join();
+    for (const exception_ptr& err : errors)
+        if (err)
+            rethrow_exception(err);
+
+    for (const IngestStats& st : stageStats)
+        addCounts(stats, st);
+    for (const auto& part : parts)
+        stats.rehashes += part->rehashes();
+
+    PhaseTimer t(stats.mergeMs, observer, "merge");
+    TraceScope trace("append partitions", "merge");
+    for (auto& part : parts) {
+        agg.absorb(move(*part));
+        part.reset();
+    }
+}
+
+
+void TripAnalyzer::ingestFile(const string& csvPath) {
+    TraceScope trace("ingestFile", "ingest");
+    impl->clear();
+
+    ifstream file(csvPath, ios::in | ios::binary);
+    if (!file.is_open())
+        return;
+
+    file.seekg(0, ios::end);
+    const uint64_t size = (uint64_t)file.tellg();
+    file.seekg(0);
+
+    CardinalityEstimate est;
+    {
+        TraceScope sizing("sample zones", "ingest");
+        PhaseTimer t(impl->stats.sizingMs);
+        est = sampleZones(file, size, *impl->filter);
+        impl->agg.reserve(withSlack(est.zones()));
+    }
+    impl->stats.estimatedZones = llround(est.zones());
+
+    int threads = 1;
+    if (impl->options.mode != IngestMode::Sequential) {
+        threads = impl->options.threads;
+        if (threads == 0)
+            threads = max(1, (int)thread::hardware_concurrency());
+    }
+
+    try {
+        dispatchBuckets(impl->bucketsPerDay, [&](auto buckets) {
+            constexpr int B = decltype(buckets)::value;
+            if (impl->options.mode == IngestMode::Pipeline) {
+                impl->ingestPipeline<B>(csvPath, threads, est);
+            } else if (threads > 1) {
+                impl->ingestParallel<B>(file, csvPath, size, threads, est);
+            } else {
+                LineReader reader(file);
+                ingestRange<B>(reader, true, *impl->filter, impl->observer, impl->events, impl->stats,
+                               [&](const vector<RowEvent>& batch) { impl->agg.add(batch); });
+                impl->stats.bytesRead += reader.bytesRead();
+                impl->stats.ioMs += reader.readSeconds() * 1000;
+            }
+        });
+    } catch (const FileVanished&) {
+        impl->clear();
+        return;
+    }
+    impl->agg.tableStats(impl->stats);
+    impl->stats.rehashes += impl->agg.rehashes();
+    trace.setArg("rows", impl->stats.rowsAccepted);
+
+    file.close();
+}
+
+
+IngestStats TripAnalyzer::stats() const {
+    IngestStats st = impl->stats;
+    st.rankMs = impl->rankNs.load(memory_order_relaxed) / 1e6;
+    return st;
+}
+
+
+MemoryUsage TripAnalyzer::memoryUsage() const {
+    MemoryUsage mu;
+    impl->agg.memoryUsage(mu);
+    mu.filter = impl->filter->bytes();
+    mu.total = mu.zoneDictionary + mu.zoneCounters + mu.slotCounters + mu.dayIndex + mu.filter;
+    mu.bytesPerZone = impl->agg.zones() ? (double)mu.total / impl->agg.zones() : 0;
+    return mu;
+}
+
+
+long long peakRssKb() {
+#if defined(__APPLE__)
+    rusage ru;
+    return getrusage(RUSAGE_SELF, &ru) == 0 ? (long long)ru.ru_maxrss / 1024 : -1;   // bytes there
+#elif defined(__unix__)
+    rusage ru;
+    return getrusage(RUSAGE_SELF, &ru) == 0 ? (long long)ru.ru_maxrss : -1;
+#else
+    return -1;
+#endif
+}
+
+
+// Keeps the k best candidates offered so far. `better(a, b)` is true when a
+// ranks ahead of b, so the heap top is the weakest kept candidate and a full
+// heap rejects most candidates with a single comparison.
+template <class T, class Better>
+class TopK {
+public:
+    TopK(int k, Better better) : k(k), better(better), heap(better) {}
+
+    void offer(const T& x) {
+        if (k <= 0)
+            return;
+        if ((int)heap.size() == k) {
+            if (!better(x, heap.top()))
+                return;
+            heap.pop();
+        }
+        heap.push(x);
+    }
+
+    // Best first.
+    vector<T> take() {
+        vector<T> result(heap.size());
+        for (int i = (int)heap.size() - 1; i >= 0; --i) {
+            result[i] = heap.top();
+            heap.pop();
+        }
+        return result;
+    }
+
+private:
+    int k;
+    Better better;
+    priority_queue<T, vector<T>, Better> heap;
+};
+
+
+vector<ZoneCount> TripAnalyzer::topZones(int k) const {
+    TraceScope trace("topZones", "query");
+    PhaseTimer t(impl->rankNs, impl->observer, "rank");
+    const Aggregates& agg = impl->agg;
+
+    auto cmp = [&](uint32_t a, uint32_t b) {
+        if (agg.total(a) != agg.total(b))
+            return agg.total(a) > agg.total(b);
+        return agg.nameBefore(a, b);
+    };
+
+    TopK<uint32_t, decltype(cmp)> top(k, cmp);
+    for (uint32_t z = 0; z < agg.zones(); ++z)
+        top.offer(z);
+
+    vector<ZoneCount> result;
+    for (uint32_t z : top.take())
+        result.push_back({agg.name(z), agg.total(z)});
+    return result;
+}
+
+
+// slot = weekday * BucketsPerDay + bucket, so ascending slot order is
+// weekday asc, hour asc, minute asc. The undated row counts towards the
+// daily ranking only.
+template <int BucketsPerDay>
+vector<SlotRef> TripAnalyzer::Impl::topSlotRefs(int k, bool byWeekday) const {
+    constexpr int kSlotsPerZone = kSlotWeekdays * BucketsPerDay;
+    constexpr int kDatedSlots = kWeekdays * BucketsPerDay;
+
+    auto cmp = [&](const SlotRef& a, const SlotRef& b) {
+        if (a.count != b.count)
+            return a.count > b.count;
+        if (a.zone != b.zone)
+            return agg.nameBefore(a.zone, b.zone);
+        return a.slot < b.slot;
+    };
+
+    TopK<SlotRef, decltype(cmp)> top(k, cmp);
+    auto scan = [&](uint32_t z, const auto* row) {
+        if (byWeekday) {
+            for (int s = 0; s < kDatedSlots; ++s)
+                if (row[s] > 0)
+                    top.offer({(long long)row[s], z, s});
+            return;
+        }
+
+        long long daily[BucketsPerDay] = {};
+        for (int d = 0; d < kSlotWeekdays; ++d)
+            for (int b = 0; b < BucketsPerDay; ++b)
+                daily[b] += row[d * BucketsPerDay + b];
+
+        for (int b = 0; b < BucketsPerDay; ++b)
+            if (daily[b] > 0)
+                top.offer({daily[b], z, b});
+    };
+
+    // a sparse zone offers its few slots, merged by bucket for the daily
+    // ranking
+    using SlotRow = Aggregates::SlotRow;
+    auto scanSparse = [&](uint32_t z, const SlotRow& r) {
+        long long counts[SlotRow::kSparse];
+        int slots[SlotRow::kSparse];
+        int n = 0;
+        for (int i = 0; i < SlotRow::kSparse && r.count[i] != 0; ++i) {
+            if (byWeekday && r.slot[i] >= kDatedSlots)
+                continue;
+            const int s = byWeekday ? r.slot[i] : r.slot[i] % BucketsPerDay;
+            int j = 0;
+            while (j < n && slots[j] != s)
+                ++j;
+            if (j == n) {
+                slots[n] = s;
+                counts[n++] = 0;
+            }
+            counts[j] += r.count[i];
+        }
+        for (int j = 0; j < n; ++j)
+            top.offer({counts[j], z, slots[j]});
+    };
+
+    // dense rows in memory order, read in place unless a counter has
+    // wrapped; then the sparse zones
+    long long wide[kSlotsPerZone];
+    for (uint32_t r = 0; r < agg.denseRows(); ++r) {
+        const uint32_t z = agg.denseZone(r);
+        if (const uint32_t* row = agg.narrowRow(r)) {
+            scan(z, row);
+        } else {
+            agg.slots(z, wide);
+            scan(z, wide);
+        }
+    }
+    for (uint32_t z = 0; z < agg.zones(); ++z) {
+        const SlotRow& r = agg.slotRow(z);
+        if (r.isSparse())
+            scanSparse(z, r);
+    }
+    return top.take();
+}
+
+
+vector<SlotCount> TripAnalyzer::topBusySlots(int k) const {
+    TraceScope trace("topBusySlots", "query");
+    PhaseTimer t(impl->rankNs, impl->observer, "rank");
+    const int perHour = impl->bucketsPerDay / kHours;
+    auto refs = dispatchBuckets(impl->bucketsPerDay, [&](auto buckets) {
+        return impl->topSlotRefs<decltype(buckets)::value>(k, false);
+    });
+
+    vector<SlotCount> result;
+    for (const SlotRef& s : refs)
+        result.push_back({impl->agg.name(s.zone), s.slot / perHour, s.count,
+                          s.slot % perHour * impl->minutesPerBucket});
+    return result;
+}
+
+
+vector<WeekdaySlotCount> TripAnalyzer::topWeekdaySlots(int k) const {
+    TraceScope trace("topWeekdaySlots", "query");
+    PhaseTimer t(impl->rankNs, impl->observer, "rank");
+    const int perHour = impl->bucketsPerDay / kHours;
+    auto refs = dispatchBuckets(impl->bucketsPerDay, [&](auto buckets) {
+        return impl->topSlotRefs<decltype(buckets)::value>(k, true);
+    });
+
+    vector<WeekdaySlotCount> result;
+    for (const SlotRef& s : refs) {
+        const int bucket = s.slot % impl->bucketsPerDay;
+        result.push_back({impl->agg.name(s.zone), s.slot / impl->bucketsPerDay,
+                          bucket / perHour, s.count, bucket % perHour * impl->minutesPerBucket});
+    }
+    return result;
+}
+
+
+vector<ZoneCount> TripAnalyzer::topZonesBetween(const string& fromDate, const string& toDate, int k) const {
+    TraceScope trace("topZonesBetween", "query");
+    PhaseTimer t(impl->rankNs, impl->observer, "rank");
+    const DayCode from = checkedDay(fromDate);
+    const DayCode to = checkedDay(toDate);
+    const Aggregates& agg = impl->agg;
+
+    vector<long long> counts(agg.zones());
+    auto cmpId = [&](uint32_t a, uint32_t b) {
+        if (counts[a] != counts[b])
+            return counts[a] > counts[b];
+        return agg.nameBefore(a, b);
+    };
+
+    TopK<uint32_t, decltype(cmpId)> top(k, cmpId);
+    for (uint32_t z = 0; z < agg.zones(); ++z) {
+        counts[z] = agg.days(z).sum(from, to);
+        if (counts[z] > 0)
+            top.offer(z);
+    }
+
+    vector<ZoneCount> result;
+    for (uint32_t z : top.take())
+        result.push_back({agg.name(z), counts[z]});
+    return result;
+}
+
+
+vector<DayCount> TripAnalyzer::dailyCounts(const string& zone, const string& fromDate,
+                                           const string& toDate) const {
+    const DayCode from = checkedDay(fromDate);
+    const DayCode to = checkedDay(toDate);
+
+    vector<DayCount> result;
+    uint32_t z;
+    if (!impl->agg.find(zone, z))
+        return result;
+
+    impl->agg.days(z).forEach(from, to, [&](DayCode day, uint32_t n) {
+        result.push_back({formatDay(day), n});
+    });
+    return result;
+}
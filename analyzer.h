@@ -1,26 +1,181 @@
-#pragma once
-#include <string>
-#include <vector>
-
-struct ZoneCount {
-    std::string zone;
-    long long count;
-};
-
-struct SlotCount {
-    std::string zone;
-    int hour;              // 0–23
-    long long count;
-};
-
-class TripAnalyzer {
-public:
-    // Parse Trips.csv, skip dirty rows, never crash
-    void ingestFile(const std::string& csvPath);
-
-    // Top K zones: count desc, zone asc
-    std::vector<ZoneCount> topZones(int k = 10) const;
-
-    // Top K slots: count desc, zone asc, hour asc
-    std::vector<SlotCount> topBusySlots(int k = 10) const;
-};
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+
+struct ZoneCount {
+    std::string zone;
+    long long count;
+};
+
+struct SlotCount {
+    std::string zone;
+    int hour;              // 0–23
+    long long count;
+    int minute = 0;        // bucket start within the hour
+};
+
+struct WeekdaySlotCount {
+    std::string zone;
+    int weekday;           // 0–6, Monday = 0
+    int hour;              // 0–23
+    long long count;
+    int minute = 0;        // bucket start within the hour
+};
+
+struct DayCount {
+    std::string date;      // YYYY-MM-DD
+    long long count;
+};
+
+// Rows an ingest keeps; a row must pass every set condition to be counted.
+struct IngestFilter {
+    std::string fromDate;                 // YYYY-MM-DD, inclusive; empty = unbounded
+    std::string toDate;                   // YYYY-MM-DD, inclusive; empty = unbounded
+                                          // (either bound drops rows whose date doesn't parse)
+    int fromHour = 0;                     // inclusive; fromHour > toHour wraps past midnight
+    int toHour = 23;
+    std::vector<std::string> allowZones;  // empty (and no allowZonesFile) = every zone
+    std::string allowZonesFile;           // one zone per line, added to allowZones
+    std::vector<std::string> denyZones;
+};
+
+// How ingestFile reads the file.
+enum class IngestMode {
+    Sequential,       // one thread reads, parses and counts the whole file
+    Parallel,         // threads count line-aligned morsels, then merge
+    Pipeline          // a reader thread feeds parser threads, which feed aggregator
+                      // threads that each own a hash partition of the zones
+};
+
+// How a Parallel ingest combines what its threads count.
+enum class Aggregation {
+    Auto,             // Partitioned when the sampled zone count makes merging costly
+    PerThread,        // every thread counts into its own full table; tables are merged
+    Partitioned       // threads scatter rows by zone hash; each partition is counted
+                      // by one thread, so no zone is in two tables
+};
+
+struct IngestOptions {
+    IngestMode mode = IngestMode::Sequential;
+    Aggregation aggregation = Aggregation::Auto;  // Parallel only
+    int threads = 0;                      // Parallel: workers; Pipeline: parsers plus
+                                          // aggregators, half each; 0 = hardware concurrency
+};
+
+// What the last ingestFile did and where its time went. Every non-empty line
+// after the header is seen once and ends up accepted, filtered or rejected
+// for exactly one reason. In a parallel ingest the io, parse and aggregate
+// times are summed over the threads.
+struct IngestStats {
+    long long bytesRead = 0;
+    long long rowsSeen = 0;
+    long long rowsAccepted = 0;
+    long long rowsUndated = 0;                // of those, with a date that didn't parse: counted
+                                              // by zone and hour, but no weekday or day
+    long long rowsFiltered = 0;               // dropped by the IngestFilter
+    long long rejectedMissingColumn = 0;
+    long long rejectedEmptyZone = 0;
+    long long rejectedBadTimestamp = 0;       // malformed timestamp or impossible date
+    long long rejectedBadHour = 0;            // hour or minute out of range
+
+    double ioMs = 0;                          // reading the file
+    double parseMs = 0;                       // splitting rows, filters, timestamps
+    double aggregateMs = 0;                   // zone lookups and counter updates
+    double mergeMs = 0;                       // combining per-thread counts (Parallel, Pipeline)
+    int partitions = 0;                       // of a Partitioned ingest; 0 = none
+    double sizingMs = 0;                      // sampling the file to size the tables
+    double rankMs = 0;                        // top* queries since the ingest
+
+    // zone hash table
+    long long estimatedZones = 0;             // from the sample, before the main pass
+    long long rehashes = 0;                   // growths the estimate didn't cover
+    long long zones = 0;
+    long long buckets = 0;                    // slots
+    double loadFactor = 0;
+    double avgProbe = 0;                      // mean slots inspected by a hit
+    long long maxProbe = 0;                   // longest probe sequence
+    long long hotLookups = 0;                 // zone lookups while counting rows
+    long long hotHits = 0;                    // of those, answered by the hot-key cache
+    long long runRows = 0;                    // rows that reused the previous row's zone
+                                              // (hotLookups + runRows = rowsAccepted)
+};
+
+// Estimated heap bytes held by the analyzer's tables. Containers count their
+// capacity, so this is what the process pays, not just what is in use.
+struct MemoryUsage {
+    long long zoneDictionary = 0;             // zone name -> id table and the names
+    long long zoneCounters = 0;               // per-zone totals
+    long long slotCounters = 0;               // weekday x bucket counters of every zone
+    long long dayIndex = 0;                   // per-zone daily series
+    long long filter = 0;                     // ingest filter sets and Bloom filter
+    long long total = 0;
+    double bytesPerZone = 0;                  // total / distinct zones
+};
+
+// Peak resident set of the whole process so far, in KiB; -1 where the
+// platform doesn't report it. Covers what MemoryUsage leaves out: allocator
+// overhead, buffers, and the transient peaks of an ingest.
+long long peakRssKb();
+
+// Called on the working thread around every timed phase ("parse",
+// "aggregate", "merge" or "rank"), with begin = true as the phase starts and
+// false once its time is taken. Meant for profilers such as hardware counters.
+// Parallel and pipelined ingests, and queries made from several threads,
+// call it concurrently from each of their threads with the same ctx; a hook
+// has to be thread-safe or tell the threads apart itself.
+typedef void (*PhaseHook)(void* ctx, const char* phase, bool begin);
+
+class TripAnalyzer {
+public:
+    // Slot granularity in minutes: 5, 15, 30 or 60 (throws std::invalid_argument otherwise)
+    explicit TripAnalyzer(int minutesPerBucket = 60);
+    ~TripAnalyzer();
+
+    TripAnalyzer(TripAnalyzer&&) noexcept;
+    TripAnalyzer& operator=(TripAnalyzer&&) noexcept;
+
+    // Filter for subsequent ingestFile calls, checked on raw row bytes before counting.
+    // Throws std::invalid_argument on a malformed date or an hour outside 0–23,
+    // std::runtime_error if allowZonesFile can't be read.
+    void setIngestFilter(const IngestFilter& filter);
+
+    // Threading for subsequent ingestFile calls; results don't depend on it.
+    // Throws std::invalid_argument on a negative thread count.
+    void setIngestOptions(const IngestOptions& options);
+
+    // Hook for the phases of subsequent ingests and queries; nullptr removes it.
+    void setPhaseHook(PhaseHook hook, void* ctx = nullptr);
+
+    // Parse Trips.csv, skip dirty rows, never crash. A file that can't be
+    // opened, or reopened by the threads of a parallel ingest, counts nothing.
+    void ingestFile(const std::string& csvPath);
+
+    // Top K zones: count desc, zone asc
+    std::vector<ZoneCount> topZones(int k = 10) const;
+
+    // Top K slots: count desc, zone asc, hour asc, minute asc
+    std::vector<SlotCount> topBusySlots(int k = 10) const;
+
+    // Top K weekday slots: count desc, zone asc, weekday asc, hour asc, minute asc
+    std::vector<WeekdaySlotCount> topWeekdaySlots(int k = 10) const;
+
+    // Top K zones by trips picked up in [fromDate, toDate] (YYYY-MM-DD, inclusive):
+    // count desc, zone asc. Throws std::invalid_argument on a malformed date.
+    std::vector<ZoneCount> topZonesBetween(const std::string& fromDate, const std::string& toDate,
+                                           int k = 10) const;
+
+    // Per-day trip counts of one zone in [fromDate, toDate], date asc, days without trips omitted.
+    std::vector<DayCount> dailyCounts(const std::string& zone, const std::string& fromDate,
+                                      const std::string& toDate) const;
+
+    // Counters and phase timings of the last ingestFile (and queries since).
+    IngestStats stats() const;
+
+    // Memory held by the counts of the last ingestFile and the current filter.
+    MemoryUsage memoryUsage() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
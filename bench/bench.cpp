@@ -0,0 +1,376 @@
+#include "analyzer.h"
+#include "perf_counters.h"
+#include "trip_gen.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Ingest and query throughput on generated trip data.
+//
+//   ./benchmark                  run the preset scenarios
+//   ./benchmark --rows 5000000 --zones 500000 --zipf 1.1 --hours commute
+//           --dirty 0.05 --crlf --days 90 --seed 7 --reps 5 --k 10
+//   ./benchmark --colliding      pickup zone IDs that all collide under std::hash
+//   ./benchmark --wide-head 0.25 only the first quarter of rows spread over all zones
+//   ./benchmark --run-length 200 each pickup zone repeats for 200 rows
+//   ./benchmark --file Trips.csv measure an existing file instead
+//   --keep                       leave generated CSVs in place
+//   --perf                       hardware counters per phase (Linux perf events)
+//   --threads 1,2,4              also time parallel (per-thread and partitioned)
+//                                and pipelined ingests at each thread count
+//
+// Every phase reports the fastest of --reps runs; --perf counters are the
+// mean over all runs.
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+
+struct Scenario {
+    string name;
+    TripGenConfig cfg;
+    string file;                 // measure this file instead of generating one
+};
+
+
+struct Options {
+    vector<Scenario> scenarios;
+    int reps = 3;
+    int k = 10;
+    bool keep = false;
+    bool perf = false;
+    vector<int> threads;         // scaling runs
+};
+
+
+static double msSince(Clock::time_point t0) {
+    return chrono::duration<double, milli>(Clock::now() - t0).count();
+}
+
+
+static long long fileSize(const string& path) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f)
+        return -1;
+    fseek(f, 0, SEEK_END);
+    const long long n = ftell(f);
+    fclose(f);
+    return n;
+}
+
+
+static vector<Scenario> presets() {
+    vector<Scenario> v(9);
+
+    v[0].name = "skewed";            // C1-like: a few zones take most trips
+    v[0].cfg.zones = 1000;
+    v[0].cfg.zipf = 1.2;
+    v[0].cfg.hours = HourProfile::Commute;
+
+    v[1].name = "high-cardinality";  // C2-like: 500k zones, one hour
+    v[1].cfg.zones = 500000;
+    v[1].cfg.hours = HourProfile::Fixed;
+
+    v[2].name = "uniform";           // C3-like: flat over zones and hours
+    v[2].cfg.zones = 10000;
+
+    v[3].name = "dirty";
+    v[3].cfg.zones = 10000;
+    v[3].cfg.dirtyRatio = 0.3;
+
+    v[4].name = "crlf";
+    v[4].cfg.zones = 10000;
+    v[4].cfg.crlf = true;
+
+    v[5].name = "colliding";         // crafted zone IDs, one std::hash value
+    v[5].cfg.zones = 20000;
+    v[5].cfg.collidingZones = true;
+
+    v[6].name = "uneven";            // costly rows bunched at the start of the file
+    v[6].cfg.zones = 500000;
+    v[6].cfg.wideHead = 0.25;
+
+    v[7].name = "clustered";         // sorted-by-zone export: runs of 200 rows per zone
+    v[7].cfg.zones = 10000;
+    v[7].cfg.runLength = 200;
+
+    for (Scenario& s : v)
+        s.cfg.rows = 2000000;
+
+    v[8].name = "million-zones";     // C2 scaled up: the zone table is far beyond cache
+    v[8].cfg.zones = 1000000;
+    v[8].cfg.rows = 3000000;
+    v[8].cfg.hours = HourProfile::Fixed;
+    return v;
+}
+
+
+static bool parseArgs(int argc, char** argv, Options& opt) {
+    Scenario custom;
+    custom.name = "custom";
+    bool haveCustom = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const string a = argv[i];
+        const char* v = i + 1 < argc ? argv[i + 1] : nullptr;
+        auto value = [&]() { ++i; return v; };
+
+        if (a == "--keep") {
+            opt.keep = true;
+        } else if (a == "--perf") {
+            opt.perf = true;
+        } else if (a == "--crlf") {
+            custom.cfg.crlf = haveCustom = true;
+        } else if (a == "--colliding") {
+            custom.cfg.collidingZones = haveCustom = true;
+        } else if (!v) {
+            fprintf(stderr, "bench: unknown or incomplete option %s\n", a.c_str());
+            return false;
+        } else if (a == "--reps") {
+            opt.reps = max(1, atoi(value()));
+        } else if (a == "--k") {
+            opt.k = atoi(value());
+        } else if (a == "--file") {
+            custom.file = value();
+            custom.name = custom.file;
+            haveCustom = true;
+        } else if (a == "--rows") {
+            custom.cfg.rows = atoll(value());
+            haveCustom = true;
+        } else if (a == "--zones") {
+            custom.cfg.zones = atoi(value());
+            haveCustom = true;
+        } else if (a == "--zipf") {
+            custom.cfg.zipf = atof(value());
+            haveCustom = true;
+        } else if (a == "--days") {
+            custom.cfg.days = atoi(value());
+            haveCustom = true;
+        } else if (a == "--dirty") {
+            custom.cfg.dirtyRatio = atof(value());
+            haveCustom = true;
+        } else if (a == "--run-length") {
+            custom.cfg.runLength = atoi(value());
+            haveCustom = true;
+        } else if (a == "--wide-head") {
+            custom.cfg.wideHead = atof(value());
+            haveCustom = true;
+        } else if (a == "--threads") {
+            for (const char* p = value(); *p; ) {
+                const int n = atoi(p);
+                if (n < 1) {
+                    fprintf(stderr, "bench: --threads takes a list like 1,2,4\n");
+                    return false;
+                }
+                opt.threads.push_back(n);
+                p += strcspn(p, ",");
+                p += *p == ',';
+            }
+        } else if (a == "--seed") {
+            custom.cfg.seed = strtoull(value(), nullptr, 10);
+            haveCustom = true;
+        } else if (a == "--hours") {
+            if (!parseHourProfile(value(), custom.cfg)) {
+                fprintf(stderr, "bench: --hours takes uniform, commute or fixed:H\n");
+                return false;
+            }
+            haveCustom = true;
+        } else {
+            fprintf(stderr, "bench: unknown option %s\n", a.c_str());
+            return false;
+        }
+    }
+
+    if (haveCustom)
+        opt.scenarios.push_back(custom);
+    else
+        opt.scenarios = presets();
+    return true;
+}
+
+
+struct Timings {
+    double ingest = 1e300;
+    IngestStats phases;          // of the fastest ingest
+    MemoryUsage memory;
+    vector<double> queries;
+};
+
+
+// peakRssKb() in MB; -1 where unavailable.
+static double peakRssMb() {
+    const long long kb = peakRssKb();
+    return kb < 0 ? -1 : kb * 1024 / 1e6;
+}
+
+
+// IPC and misses per row (per call for rank) of each phase, averaged over reps.
+static void printCounters(const PerfCounters& pc, long long rows, int reps) {
+    for (const auto& p : pc.phases()) {
+        const PhaseCounters& c = p.second;
+        const bool perCall = p.first == "rank";
+        const double n = perCall ? (double)c.spans : (double)rows * reps;
+        if (n <= 0)
+            continue;
+        printf("%-18s perf %-10s IPC %.2f  cycles %.1f  instr %.1f  cache-miss %.3f  branch-miss %.3f  per %s\n",
+               "", p.first.c_str(), c.cycles ? (double)c.instructions / c.cycles : 0.0,
+               c.cycles / n, c.instructions / n, c.cacheMisses / n, c.branchMisses / n,
+               perCall ? "call" : "row");
+    }
+}
+
+
+// Parallel ingests with either aggregation, and pipelined ones, at each
+// --threads count, best of reps, with the speedup over the first run.
+static void printScaling(const string& path, const Options& opt) {
+    struct Variant {
+        const char* name;
+        IngestMode mode;
+        Aggregation aggregation;
+    };
+    const Variant variants[] = {
+        {"per-thread", IngestMode::Parallel, Aggregation::PerThread},
+        {"partitioned", IngestMode::Parallel, Aggregation::Partitioned},
+        {"pipeline", IngestMode::Pipeline, Aggregation::Auto},
+    };
+
+    double base = 0;
+    for (const Variant& v : variants) {
+        for (int n : opt.threads) {
+            IngestOptions io;
+            io.mode = v.mode;
+            io.aggregation = v.aggregation;
+            io.threads = n;
+            double best = 1e300, merge = 0;
+            for (int r = 0; r < opt.reps; ++r) {
+                TripAnalyzer ta;
+                ta.setIngestOptions(io);
+                const auto t0 = Clock::now();
+                ta.ingestFile(path);
+                const double ms = msSince(t0);
+                if (ms < best) {
+                    best = ms;
+                    merge = ta.stats().mergeMs;
+                }
+            }
+            if (base == 0)
+                base = best;
+            printf("%-18s %-11s %2d threads  ingest %9.2f ms  merge %7.2f ms  speedup %.2fx\n", "",
+                   v.name, n, best, merge, base / best);
+        }
+    }
+}
+
+
+static void run(const Scenario& sc, const Options& opt, PerfCounters* pc) {
+    string path = sc.file;
+    if (path.empty()) {
+        path = "bench_" + sc.name + ".csv";
+        if (writeTripsFile(sc.cfg, path) < 0) {
+            fprintf(stderr, "bench: cannot write %s\n", path.c_str());
+            return;
+        }
+    }
+    const long long bytes = fileSize(path);
+    if (bytes < 0) {
+        fprintf(stderr, "bench: cannot read %s\n", path.c_str());
+        return;
+    }
+
+    const int k = opt.k;
+    const vector<pair<const char*, function<size_t(const TripAnalyzer&)>>> queries = {
+        {"topZones",        [k](const TripAnalyzer& ta) { return ta.topZones(k).size(); }},
+        {"topBusySlots",    [k](const TripAnalyzer& ta) { return ta.topBusySlots(k).size(); }},
+        {"topWeekdaySlots", [k](const TripAnalyzer& ta) { return ta.topWeekdaySlots(k).size(); }},
+        {"topZonesBetween", [k](const TripAnalyzer& ta) { return ta.topZonesBetween("2024-03-01", "2024-03-31", k).size(); }},
+    };
+
+    Timings best;
+    best.queries.assign(queries.size(), 1e300);
+    volatile size_t sink = 0;     // keeps the query results observable
+    if (pc)
+        pc->reset();
+    for (int r = 0; r < opt.reps; ++r) {
+        TripAnalyzer ta;
+        if (pc)
+            ta.setPhaseHook(PerfCounters::hook, pc);
+        auto t0 = Clock::now();
+        ta.ingestFile(path);
+        const double ms = msSince(t0);
+        if (ms < best.ingest) {
+            best.ingest = ms;
+            best.phases = ta.stats();
+            best.memory = ta.memoryUsage();
+        }
+
+        for (size_t q = 0; q < queries.size(); ++q) {
+            t0 = Clock::now();
+            sink += queries[q].second(ta);
+            best.queries[q] = min(best.queries[q], msSince(t0));
+        }
+    }
+
+    // rows counted from the file so --file inputs report correctly
+    long long rows = 0;
+    if (FILE* f = fopen(path.c_str(), "rb")) {
+        char buf[1 << 16];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+            rows += count(buf, buf + n, '\n');
+        fclose(f);
+        rows = max(0LL, rows - 1);
+    }
+
+    const double mb = bytes / 1e6;
+    printf("%-18s %10lld %8.1f MB  ingest %9.2f ms  %7.2f Mrows/s  %7.1f MB/s\n",
+           sc.name.c_str(), rows, mb, best.ingest, rows / best.ingest / 1e3, mb / best.ingest * 1e3);
+    const IngestStats& st = best.phases;
+    printf("%-18s io %.2f ms  parse %.2f ms  aggregate %.2f ms  accepted %lld of %lld rows\n", "",
+           st.ioMs, st.parseMs, st.aggregateMs, st.rowsAccepted, st.rowsSeen);
+    printf("%-18s zone table: %lld zones (estimated %lld in %.2f ms)  %lld rehashes  load %.2f"
+           "  probes avg %.2f max %lld  hot-key hits %.1f%%  run rows %.1f%%\n", "",
+           st.zones, st.estimatedZones, st.sizingMs, st.rehashes, st.loadFactor, st.avgProbe, st.maxProbe,
+           st.hotLookups ? 100.0 * st.hotHits / st.hotLookups : 0.0,
+           st.rowsAccepted ? 100.0 * st.runRows / st.rowsAccepted : 0.0);
+    const MemoryUsage& mu = best.memory;
+    printf("%-18s memory: dictionary %.1f MB  slots %.1f MB  days %.1f MB  total %.1f MB"
+           "  %.0f B/zone  peak RSS %.1f MB\n", "",
+           mu.zoneDictionary / 1e6, mu.slotCounters / 1e6, mu.dayIndex / 1e6, mu.total / 1e6,
+           mu.bytesPerZone, peakRssMb());
+    for (size_t q = 0; q < queries.size(); ++q)
+        printf("%-18s %-24s %9.3f ms\n", "", queries[q].first, best.queries[q]);
+    if (pc)
+        printCounters(*pc, st.rowsSeen, opt.reps);
+    printScaling(path, opt);
+    fflush(stdout);
+
+    if (sc.file.empty() && !opt.keep)
+        remove(path.c_str());
+}
+
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseArgs(argc, argv, opt))
+        return 2;
+
+    printf("reps=%d k=%d (best of reps)\n", opt.reps, opt.k);
+
+    PerfCounters counters;
+    PerfCounters* pc = nullptr;
+    if (opt.perf) {
+        if (counters.available())
+            pc = &counters;
+        else
+            printf("perf counters unavailable (%s); timings only\n", counters.error().c_str());
+    }
+
+    for (const Scenario& sc : opt.scenarios)
+        run(sc, opt, pc);
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include "perf_counters.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+
+#ifdef __linux__
+
+static int openCounter(uint64_t config, int group) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = group < 0;          // the group starts with its leader
+    attr.exclude_kernel = 1;            // allowed at perf_event_paranoid 2
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+
+PerfCounters::PerfCounters() {
+    static const uint64_t configs[4] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+    };
+    for (int i = 0; i < 4; ++i) {
+        fds[i] = openCounter(configs[i], i == 0 ? -1 : fds[0]);
+        if (fds[i] < 0) {
+            why = string("perf_event_open: ") + strerror(errno);
+            for (int j = 0; j < i; ++j)
+                close(fds[j]);
+            fill(fds, fds + 4, -1);
+            return;
+        }
+    }
+    leader = fds[0];
+    ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+
+PerfCounters::~PerfCounters() {
+    for (int fd : fds)
+        if (fd >= 0)
+            close(fd);
+}
+
+
+bool PerfCounters::read(uint64_t out[4]) const {
+    uint64_t buf[5];                    // nr, then one value per counter
+    if (::read(leader, buf, sizeof(buf)) != (ssize_t)sizeof(buf) || buf[0] != 4)
+        return false;
+    memcpy(out, buf + 1, 4 * sizeof(uint64_t));
+    return true;
+}
+
+#else
+
+PerfCounters::PerfCounters() : why("hardware counters need Linux perf_event_open") {}
+PerfCounters::~PerfCounters() {}
+bool PerfCounters::read(uint64_t*) const { return false; }
+
+#endif
+
+
+void PerfCounters::hook(void* ctx, const char* phase, bool begin) {
+    PerfCounters& pc = *static_cast<PerfCounters*>(ctx);
+    if (!pc.available() || this_thread::get_id() != pc.owner)
+        return;
+
+    if (begin) {
+        pc.read(pc.atBegin);
+        return;
+    }
+
+    uint64_t now[4];
+    if (!pc.read(now))
+        return;
+    PhaseCounters& c = pc.totals[phase];
+    c.cycles += now[0] - pc.atBegin[0];
+    c.instructions += now[1] - pc.atBegin[1];
+    c.cacheMisses += now[2] - pc.atBegin[2];
+    c.branchMisses += now[3] - pc.atBegin[3];
+    ++c.spans;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <string>
+#include <thread>
+
+// Hardware counters of the calling thread via Linux perf_event_open, summed
+// per analyzer phase through TripAnalyzer::setPhaseHook. Only phases run on
+// the thread that constructed the PerfCounters are counted; the hook ignores
+// the workers of a parallel or pipelined ingest. Where perf events are
+// missing (other platforms, containers, perf_event_paranoid) available() is
+// false and the hook records nothing.
+
+struct PhaseCounters {
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t cacheMisses = 0;
+    uint64_t branchMisses = 0;
+    long long spans = 0;            // how many times the phase ran
+};
+
+class PerfCounters {
+public:
+    PerfCounters();
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available() const { return leader >= 0; }
+
+    // Why the counters couldn't be opened.
+    const std::string& error() const { return why; }
+
+    // Matches PhaseHook; pass the PerfCounters as ctx. Safe to call from any
+    // thread, but only counts on the constructing one.
+    static void hook(void* ctx, const char* phase, bool begin);
+
+    const std::map<std::string, PhaseCounters>& phases() const { return totals; }
+    void reset() { totals.clear(); }
+
+private:
+    std::thread::id owner = std::this_thread::get_id();   // whose counters these are
+    int leader = -1;
+    int fds[4] = {-1, -1, -1, -1};
+    uint64_t atBegin[4] = {};
+    std::map<std::string, PhaseCounters> totals;
+    std::string why;
+
+    bool read(uint64_t out[4]) const;
+};
@@ -0,0 +1,205 @@
+#include "trip_gen.h"
+#include "trip_parse.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+
+// Rank r (0-based) has weight 1 / (r + 1)^s.
+static vector<double> zipfCdf(int zones, double s) {
+    vector<double> cdf(max(zones, 1));
+    double sum = 0;
+    for (size_t r = 0; r < cdf.size(); ++r) {
+        sum += s == 0 ? 1.0 : 1.0 / pow((double)(r + 1), s);
+        cdf[r] = sum;
+    }
+    for (double& c : cdf)
+        c /= sum;
+    return cdf;
+}
+
+
+static vector<double> hourCdf(const TripGenConfig& cfg) {
+    vector<double> w(24, 1.0);
+    if (cfg.hours == HourProfile::Commute) {
+        for (int h = 0; h < 24; ++h)
+            w[h] = (h >= 6 && h <= 22 ? 2.0 : 0.5) +
+                   8.0 * exp(-0.5 * (h - 8) * (h - 8)) + 6.0 * exp(-0.5 * (h - 18) * (h - 18));
+    } else if (cfg.hours == HourProfile::Fixed) {
+        fill(w.begin(), w.end(), 0.0);
+        w[min(max(cfg.fixedHour, 0), 23)] = 1.0;
+    }
+
+    vector<double> cdf(24);
+    double sum = 0;
+    for (int h = 0; h < 24; ++h)
+        cdf[h] = sum += w[h];
+    for (double& c : cdf)
+        c /= sum;
+    return cdf;
+}
+
+
+static const uint64_t kMurmurMul = 0xc6a4a7935bd1e995ull;
+static const uint64_t kStdHashSeed = 0xc70f6907ull;
+
+
+static uint64_t shiftMix(uint64_t v) {
+    return v ^ (v >> 47);        // its own inverse, the shift being over half the width
+}
+
+
+// Multiplicative inverse mod 2^64 of an odd number (Newton's iteration).
+static uint64_t inverse(uint64_t a) {
+    uint64_t x = a;
+    for (int i = 0; i < 6; ++i)
+        x *= 2 - a * x;
+    return x;
+}
+
+
+// Key layout: 8 printable bytes A, 8 solved bytes B, the fixed suffix. Each
+// 8-byte block updates the hash state as h = (h ^ mix(block)) * mul with an
+// invertible mix, so for any A there is exactly one B that reaches a chosen
+// state after the second block; an equal suffix and length then give an
+// equal hash.
+vector<string> collidingZoneIds(int n) {
+    const uint64_t invMul = inverse(kMurmurMul);
+    auto mix = [](uint64_t block) { return shiftMix(block * kMurmurMul) * kMurmurMul; };
+    auto unmix = [&](uint64_t y) { return shiftMix(y * invMul) * invMul; };
+
+    const char suffix[] = "_COLLIDE";
+    const uint64_t h0 = kStdHashSeed ^ (24 * kMurmurMul);
+    const uint64_t target = 0x5eed5eed5eed5eedull;      // state after the second block
+
+    vector<string> ids;
+    static const char digits[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    for (uint64_t counter = 0; (int)ids.size() < n; ++counter) {
+        char key[24];
+        uint64_t c = counter;
+        key[0] = 'Z';
+        for (int i = 1; i < 8; ++i, c /= 62)
+            key[i] = digits[c % 62];
+
+        uint64_t a;
+        memcpy(&a, key, 8);
+        const uint64_t s1 = (h0 ^ mix(a)) * kMurmurMul;
+        const uint64_t b = unmix(s1 ^ (target * invMul));
+        memcpy(key + 8, &b, 8);
+        memcpy(key + 16, suffix, 8);
+
+        bool usable = true;
+        for (int i = 8; i < 16; ++i)
+            usable &= key[i] != 0 && key[i] != ',' && key[i] != '\r' && key[i] != '\n';
+        if (usable)
+            ids.emplace_back(key, 24);
+    }
+    return ids;
+}
+
+
+static int sample(const vector<double>& cdf, double u) {
+    const size_t i = upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+    return (int)min(i, cdf.size() - 1);
+}
+
+
+long long writeTrips(const TripGenConfig& cfg, ostream& out) {
+    mt19937_64 rng(cfg.seed);
+    uniform_real_distribution<double> unit(0.0, 1.0);
+
+    const vector<double> zones = zipfCdf(cfg.zones, cfg.zipf);
+    vector<string> names;
+    if (cfg.collidingZones) {
+        names = collidingZoneIds((int)zones.size());
+    } else {
+        for (size_t z = 0; z < zones.size(); ++z)
+            names.push_back("ZONE_" + to_string(z));
+    }
+    const vector<double> hot(zones.begin(), zones.begin() + min<size_t>(zones.size(), 16));
+    const long long wideRows = (long long)(cfg.wideHead * cfg.rows);
+    const vector<double> hours = hourCdf(cfg);
+    const int firstDay = daysFromCivil(2024, 1, 1) - kEpochDays;
+    const char* eol = cfg.crlf ? "\r\n" : "\n";
+
+    string buf;
+    buf.reserve(1 << 20);
+    buf += "TripID,PickupZoneID,DropoffZoneID,PickupDateTime,DistanceKm,FareAmount";
+    buf += eol;
+
+    long long clean = 0;
+    int zone = 0;
+    char row[160];
+    for (long long id = 1; id <= cfg.rows; ++id) {
+        if ((id - 1) % max(cfg.runLength, 1) == 0)
+            zone = id <= wideRows ? sample(zones, unit(rng)) : sample(hot, unit(rng) * hot.back());
+        const char* pickup = names[zone].c_str();
+        const int hour = sample(hours, unit(rng));
+        const int minute = (int)(rng() % 60);
+        const string date = formatDay((DayCode)(firstDay + rng() % max(cfg.days, 1)));
+        const double km = 0.5 + (rng() % 400) / 10.0;
+
+        int n;
+        if (cfg.dirtyRatio > 0 && unit(rng) < cfg.dirtyRatio) {
+            switch (rng() % 5) {
+            case 0:   // too few columns
+                n = snprintf(row, sizeof(row), "%lld,%s,ZX,%s %02d:%02d", id, pickup, date.c_str(), hour, minute);
+                break;
+            case 1:   // empty pickup zone
+                n = snprintf(row, sizeof(row), "%lld,,ZX,%s %02d:%02d,%.1f,%.1f", id, date.c_str(), hour, minute, km, 3 + km * 2.5);
+                break;
+            case 2:   // unparseable timestamp
+                n = snprintf(row, sizeof(row), "%lld,%s,ZX,NOT_A_DATE,%.1f,%.1f", id, pickup, km, 3 + km * 2.5);
+                break;
+            case 3:   // hour out of range
+                n = snprintf(row, sizeof(row), "%lld,%s,ZX,%s %02d:%02d,%.1f,%.1f", id, pickup, date.c_str(), 24 + hour % 76, minute, km, 3 + km * 2.5);
+                break;
+            default:  // not a row at all
+                n = snprintf(row, sizeof(row), "#### corrupted record %lld ####", id);
+                break;
+            }
+        } else {
+            n = snprintf(row, sizeof(row), "%lld,%s,ZONE_%d,%s %02d:%02d,%.1f,%.1f",
+                         id, pickup, (int)(rng() % max(cfg.zones, 1)), date.c_str(), hour, minute, km, 3 + km * 2.5);
+            ++clean;
+        }
+
+        buf.append(row, min(n, (int)sizeof(row) - 1));
+        buf += eol;
+        if (buf.size() >= (1 << 20) - 256) {
+            out.write(buf.data(), buf.size());
+            buf.clear();
+        }
+    }
+    out.write(buf.data(), buf.size());
+    return clean;
+}
+
+
+long long writeTripsFile(const TripGenConfig& cfg, const string& path) {
+    ofstream out(path, ios::out | ios::binary | ios::trunc);
+    if (!out.is_open())
+        return -1;
+    return writeTrips(cfg, out);
+}
+
+
+bool parseHourProfile(const string& s, TripGenConfig& cfg) {
+    if (s == "uniform") {
+        cfg.hours = HourProfile::Uniform;
+    } else if (s == "commute") {
+        cfg.hours = HourProfile::Commute;
+    } else if (s.compare(0, 6, "fixed:") == 0 && s.size() > 6) {
+        cfg.hours = HourProfile::Fixed;
+        cfg.fixedHour = atoi(s.c_str() + 6);
+    } else {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Synthetic trip data in the schema of test_trip_analyzer.cpp:
+// TripID,PickupZoneID,DropoffZoneID,PickupDateTime,DistanceKm,FareAmount
+
+enum class HourProfile {
+    Uniform,     // every hour equally likely
+    Commute,     // morning and evening peaks over a daytime base
+    Fixed        // every trip at TripGenConfig::fixedHour
+};
+
+struct TripGenConfig {
+    long long rows = 1000000;
+    int zones = 10000;           // distinct pickup zones
+    double zipf = 0.0;           // 0 = uniform; ~1 = a few zones dominate
+    HourProfile hours = HourProfile::Uniform;
+    int fixedHour = 8;
+    int days = 365;              // pickup dates spread from 2024-01-01
+    double dirtyRatio = 0.0;     // fraction of malformed rows
+    bool crlf = false;           // "\r\n" line endings
+    bool collidingZones = false; // pickup zone IDs that all share one std::hash value
+    int runLength = 1;           // consecutive rows sharing a pickup zone, as in
+                                 // exports sorted by zone
+    double wideHead = 1.0;       // rows in this leading fraction of the file draw from all
+                                 // zones, the rest from the 16 most popular only
+    uint64_t seed = 2003;
+};
+
+// Writes the header and cfg.rows rows; returns the number of clean rows.
+long long writeTrips(const TripGenConfig& cfg, std::ostream& out);
+
+// Same, into a file; returns -1 if it can't be created.
+long long writeTripsFile(const TripGenConfig& cfg, const std::string& path);
+
+// n distinct 24-byte zone IDs with the same std::hash<std::string> value,
+// built against libstdc++'s 64-bit _Hash_bytes (MurmurHash64A-style, whose
+// block mixing is invertible). Elsewhere they are just random-looking IDs.
+// Bytes are binary but never NUL, ',', '\r' or '\n', and the first and
+// last are printable.
+std::vector<std::string> collidingZoneIds(int n);
+
+// Parses "uniform", "commute" or "fixed:H"; false on anything else.
+bool parseHourProfile(const std::string& s, TripGenConfig& cfg);
@@ -0,0 +1,97 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#endif
+
+// Positional reads of a whole file for a single reader thread. On POSIX the
+// reads are pread(2) calls, and the kernel is told the file is read
+// sequentially and, ahead of each block, which bytes come next, so network
+// or cold storage can fetch them while the previous block is being parsed.
+// Elsewhere it falls back to an ifstream and ignores the hints.
+class BlockReader {
+public:
+    explicit BlockReader(const std::string& path) {
+#if defined(__unix__) || defined(__APPLE__)
+        fd = ::open(path.c_str(), O_RDONLY);
+#ifdef POSIX_FADV_SEQUENTIAL
+        if (fd >= 0)
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#else
+        in.open(path, std::ios::in | std::ios::binary);
+#endif
+    }
+
+    ~BlockReader() {
+#if defined(__unix__) || defined(__APPLE__)
+        if (fd >= 0)
+            ::close(fd);
+#endif
+    }
+
+    BlockReader(const BlockReader&) = delete;
+    BlockReader& operator=(const BlockReader&) = delete;
+
+    bool isOpen() const {
+#if defined(__unix__) || defined(__APPLE__)
+        return fd >= 0;
+#else
+        return in.is_open();
+#endif
+    }
+
+    // Up to n bytes at offset into dst; fewer only at end of file. Returns
+    // what was read, 0 at end of file or on an error.
+    size_t readAt(uint64_t offset, char* dst, size_t n) {
+        const auto t0 = std::chrono::steady_clock::now();
+        size_t got = 0;
+#if defined(__unix__) || defined(__APPLE__)
+        while (got < n) {
+            const ssize_t r = ::pread(fd, dst + got, n - got, (off_t)(offset + got));
+            if (r <= 0)
+                break;
+            got += (size_t)r;
+        }
+#else
+        in.clear();
+        in.seekg(offset);
+        in.read(dst, n);
+        got = (size_t)in.gcount();
+#endif
+        readTime += std::chrono::steady_clock::now() - t0;
+        total += got;
+        return got;
+    }
+
+    // Asks for [offset, offset + n) to be read ahead.
+    void willNeed(uint64_t offset, size_t n) {
+#if defined(POSIX_FADV_WILLNEED)
+        posix_fadvise(fd, (off_t)offset, (off_t)n, POSIX_FADV_WILLNEED);
+#else
+        (void)offset;
+        (void)n;
+#endif
+    }
+
+    size_t bytesRead() const { return total; }
+
+    // Time spent inside reads.
+    double readSeconds() const { return std::chrono::duration<double>(readTime).count(); }
+
+private:
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = -1;
+#else
+    std::ifstream in;
+#endif
+    size_t total = 0;
+    std::chrono::steady_clock::duration readTime{};
+};
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Blocked Bloom filter over precomputed 64-bit hashes: all probes of a key
+// land in one 64-byte block, so a lookup costs at most one cache miss. At
+// 10 bits per key the false-positive rate is about 1-2%.
+class BloomFilter {
+public:
+    BloomFilter() = default;
+
+    explicit BloomFilter(size_t keys)
+        : blocks((keys * kBitsPerKey + 511) / 512 + 1) {}
+
+    void insert(uint64_t h) {
+        Block& blk = blocks[blockIndex(h)];
+        uint64_t g = probeBits(h);
+        for (int i = 0; i < kProbes; ++i, g >>= 9)
+            blk.words[(g >> 6) & 7] |= 1ull << (g & 63);
+    }
+
+    bool mayContain(uint64_t h) const {
+        if (blocks.empty())
+            return true;
+        const Block& blk = blocks[blockIndex(h)];
+        uint64_t g = probeBits(h);
+        for (int i = 0; i < kProbes; ++i, g >>= 9)
+            if (!(blk.words[(g >> 6) & 7] & (1ull << (g & 63))))
+                return false;
+        return true;
+    }
+
+    size_t bytes() const { return blocks.capacity() * sizeof(Block); }
+
+private:
+    static const int kBitsPerKey = 10;
+    static const int kProbes = 6;     // 9 bits each: word (3) + bit (6)
+
+    struct alignas(64) Block {
+        uint64_t words[8] = {};
+    };
+
+    std::vector<Block> blocks;
+
+    // Upper half picks the block, a remix of the lower half the bits in it.
+    size_t blockIndex(uint64_t h) const {
+        return (size_t)(((h >> 32) * (uint64_t)blocks.size()) >> 32);
+    }
+
+    static uint64_t probeBits(uint64_t h) {
+        return (h & 0xffffffffull) * 0x9e3779b97f4a7c15ull;
+    }
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include "memory_size.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Append-only storage for short byte strings. Copies go into 64 KB chunks
+// that never move, so the views handed out stay valid until clear().
+class ByteArena {
+public:
+    std::string_view copy(std::string_view s) {
+        if (s.size() > room) {
+            const size_t n = std::max(s.size(), kChunkBytes);
+            chunks.emplace_back(new char[n]);
+            sizes.push_back(n);
+            at = chunks.back().get();
+            room = n;
+        }
+        memcpy(at, s.data(), s.size());
+        const std::string_view out(at, s.size());
+        at += s.size();
+        room -= s.size();
+        return out;
+    }
+
+    void clear() {
+        chunks.clear();
+        sizes.clear();
+        at = nullptr;
+        room = 0;
+    }
+
+    size_t bytes() const {
+        size_t n = vectorBytes(chunks) + vectorBytes(sizes);
+        for (size_t s : sizes)
+            n += s;
+        return n;
+    }
+
+private:
+    static constexpr size_t kChunkBytes = 64 << 10;
+
+    std::vector<std::unique_ptr<char[]>> chunks;
+    std::vector<size_t> sizes;
+    char* at = nullptr;
+    size_t room = 0;
+};
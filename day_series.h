@@ -0,0 +1,153 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Days since 1970-01-01, which covers pickup dates up to 2149-06-05. Rows
+// dated outside that still count everywhere but in the day series.
+typedef uint16_t DayCode;
+
+// The day of a row without a date in that range; DayColumn::add ignores it.
+const DayCode kNoDay = UINT16_MAX;
+
+// Daily trip counts of one zone. A column starts sparse, as (day, count)
+// word pairs sorted by day, and switches to one counter per day of its span
+// once that is no larger; exported data is mostly clustered by date, so busy
+// zones end up dense and long-tail zones stay a handful of words. A day that
+// would stretch a dense column past twice its non-zero days turns it back
+// into pairs, so one stray date can't allocate the decades in between.
+class DayColumn {
+public:
+    void add(DayCode day, uint32_t n = 1) {
+        if (day == kNoDay)
+            return;
+        if (dense) {
+            addDense(day, n);
+            return;
+        }
+
+        // Sorted exports hit the last entry or append.
+        size_t i = data.size();
+        if (i == 0 || data[i - 2] < day) {
+            data.push_back(day);
+            data.push_back(n);
+        } else if (data[i - 2] == day) {
+            data[i - 1] += n;
+        } else {
+            i = lowerBound(day);
+            if (i < data.size() && data[i] == day) {
+                data[i + 1] += n;
+                return;
+            }
+            const uint32_t entry[] = {day, n};
+            data.insert(data.begin() + i, entry, entry + 2);
+        }
+        maybeDensify();
+    }
+
+    // Adds every count of other, in day order so the sparse form appends.
+    void merge(const DayColumn& other) {
+        other.forEach(0, 0xFFFF, [&](DayCode day, uint32_t n) { add(day, n); });
+    }
+
+    // Inclusive day range.
+    long long sum(DayCode from, DayCode to) const {
+        long long total = 0;
+        forEach(from, to, [&](DayCode, uint32_t n) { total += n; });
+        return total;
+    }
+
+    // Calls f(day, count) for each day in [from, to] with a non-zero count, in day order.
+    template <class F>
+    void forEach(DayCode from, DayCode to, F f) const {
+        if (dense) {
+            const long long lo = std::max<long long>(from, base);
+            const long long hi = std::min<long long>(to, (long long)base + data.size() - 1);
+            for (long long d = lo; d <= hi; ++d)
+                if (data[d - base] != 0)
+                    f((DayCode)d, data[d - base]);
+            return;
+        }
+        for (size_t i = lowerBound(from); i < data.size() && data[i] <= to; i += 2)
+            f((DayCode)data[i], data[i + 1]);
+    }
+
+    size_t bytes() const { return data.capacity() * sizeof(uint32_t); }
+
+private:
+    std::vector<uint32_t> data;
+    DayCode base = 0;
+    bool dense = false;
+    uint32_t nonZero = 0;         // days with a count, while dense
+
+    size_t lowerBound(DayCode day) const {
+        size_t lo = 0, hi = data.size() / 2;
+        while (lo < hi) {
+            const size_t mid = (lo + hi) / 2;
+            if (data[2 * mid] < day)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return 2 * lo;
+    }
+
+    void addDense(DayCode day, uint32_t n) {
+        if (day >= base && (size_t)(day - base) < data.size()) {
+            nonZero += data[day - base] == 0;
+            data[day - base] += n;
+            return;
+        }
+
+        const size_t lo = std::min<size_t>(day, base);
+        const size_t hi = std::max<size_t>(day, base + data.size() - 1);
+        if (hi - lo + 1 > 2 * ((size_t)nonZero + 1)) {
+            makeSparse();
+            add(day, n);
+            return;
+        }
+
+        if (day < base) {
+            // with room for as many earlier days again, so a column filled
+            // backwards in time doesn't shift on every day
+            const DayCode to = (DayCode)(day - std::min<size_t>(day, data.size() / 2));
+            data.insert(data.begin(), base - to, 0);
+            base = to;
+        } else {
+            data.resize(day - base + 1, 0);
+        }
+        ++nonZero;
+        data[day - base] += n;
+    }
+
+    void makeSparse() {
+        std::vector<uint32_t> pairs;
+        pairs.reserve(2 * nonZero + 2);
+        for (size_t i = 0; i < data.size(); ++i)
+            if (data[i] != 0) {
+                pairs.push_back((uint32_t)(base + i));
+                pairs.push_back(data[i]);
+            }
+        data.swap(pairs);
+        base = 0;
+        dense = false;
+    }
+
+    void maybeDensify() {
+        const size_t entries = data.size() / 2;
+        if (entries < 4)
+            return;
+        const size_t span = data[data.size() - 2] - data[0] + 1;
+        if (span > 2 * entries)
+            return;
+
+        std::vector<uint32_t> counts(span, 0);
+        for (size_t i = 0; i < data.size(); i += 2)
+            counts[data[i] - data[0]] = data[i + 1];
+        base = (DayCode)data[0];
+        nonZero = (uint32_t)entries;
+        data.swap(counts);
+        dense = true;
+    }
+};
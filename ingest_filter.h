@@ -0,0 +1,110 @@
+#pragma once
+#include "analyzer.h"
+#include "bloom_filter.h"
+#include "memory_size.h"
+#include "trip_parse.h"
+#include "zone_hash.h"
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+// An IngestFilter compiled for the row loop. Every check looks only at the
+// trimmed zone and timestamp fields, so a row that fails is dropped before
+// its zone is hashed into the counters or copied anywhere.
+// The IngestFilter is expected to be validated already, with the zones of
+// its allowZonesFile passed in separately.
+//
+// An allow-list can run to hundreds of thousands of zones while most rows
+// miss it, so it sits behind a Bloom filter: a miss costs one hash and one
+// cache line, and only possible members reach the exact set.
+class RowFilter {
+public:
+    RowFilter() = default;
+
+    explicit RowFilter(const IngestFilter& f, const std::vector<std::string>& fileZones = {})
+        : zones(f.allowZones.size() + fileZones.size() + f.denyZones.size()),
+          allowBloom(f.allowZones.size() + fileZones.size()),
+          seed(std::random_device()()) {
+        hasFrom = !f.fromDate.empty() && parseDate(f.fromDate, fromDays);
+        hasTo = !f.toDate.empty() && parseDate(f.toDate, toDays);
+        if (f.fromHour != 0 || f.toHour != 23) {
+            hourLo = f.fromHour;
+            hourHi = f.toHour;
+            hasHours = true;
+        }
+
+        // zones is sized up front, so the views below stay valid
+        size_t i = 0;
+        for (const auto* list : {&f.allowZones, &fileZones}) {
+            for (const auto& z : *list) {
+                zones[i] = z;
+                allow.insert(zones[i]);
+                allowBloom.insert(hashBytes(z.data(), z.size(), seed));
+                ++i;
+            }
+        }
+        for (const auto& z : f.denyZones) {
+            zones[i] = z;
+            deny.insert(zones[i++]);
+        }
+        hasAllow = !f.allowZones.empty() || !f.allowZonesFile.empty();
+    }
+
+    RowFilter(const RowFilter&) = delete;
+    RowFilter& operator=(const RowFilter&) = delete;
+
+    bool active() const {
+        return hasFrom || hasTo || hasHours || hasAllow || !deny.empty();
+    }
+
+    // Reads the date and time as parseTimestamp does. A timestamp without
+    // a valid time passes, for the full parse to reject; an undated row
+    // fails any date bound, since it can't be placed inside one.
+    bool acceptTimestamp(std::string_view ts) const {
+        if (!hasFrom && !hasTo && !hasHours)
+            return true;
+        int hour, minute;
+        if (!parseTime(ts, hour, minute) || hour > 23 || minute > 59)
+            return true;
+        if (hasFrom || hasTo) {
+            int days;
+            if (!parseDate(ts, days) || (hasFrom && days < fromDays) || (hasTo && days > toDays))
+                return false;
+        }
+        if (hasHours) {
+            // fromHour > toHour wraps past midnight
+            if (hourLo <= hourHi ? (hour < hourLo || hour > hourHi)
+                                 : (hour < hourLo && hour > hourHi))
+                return false;
+        }
+        return true;
+    }
+
+    bool acceptZone(std::string_view zone) const {
+        if (hasAllow && !allowBloom.mayContain(hashBytes(zone.data(), zone.size(), seed)))
+            return false;
+        if (!deny.empty() && deny.count(zone))
+            return false;
+        return !hasAllow || allow.count(zone);
+    }
+
+    // Estimated heap bytes of the zone sets and the Bloom filter.
+    size_t bytes() const {
+        size_t n = vectorBytes(zones) + hashTableBytes(allow) + hashTableBytes(deny) + allowBloom.bytes();
+        for (const std::string& z : zones)
+            n += heapBytes(z);
+        return n;
+    }
+
+private:
+    int fromDays = 0, toDays = 0;
+    int hourLo = 0, hourHi = 23;
+    bool hasFrom = false, hasTo = false, hasHours = false, hasAllow = false;
+
+    std::vector<std::string> zones;     // backing storage for the set views
+    std::unordered_set<std::string_view> allow, deny;
+    BloomFilter allowBloom;
+    uint64_t seed = 0;
+};
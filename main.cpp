@@ -1,31 +1,281 @@
-#include "analyzer.h"
-#include <iostream>
-#include <chrono>
-
-static void printZones(const std::vector<ZoneCount>& v) {
-    std::cout << "TOP_ZONES\n";
-    for (auto& x : v)
-        std::cout << x.zone << "," << x.count << "\n";
-}
-
-static void printSlots(const std::vector<SlotCount>& v) {
-    std::cout << "TOP_SLOTS\n";
-    for (auto& x : v)
-        std::cout << x.zone << "," << x.hour << "," << x.count << "\n";
-}
-
-int main() {
-    auto t0 = std::chrono::high_resolution_clock::now();
-
-    TripAnalyzer analyzer;
-    analyzer.ingestFile("SmallTrips.csv");
-
-    printZones(analyzer.topZones(10));
-    printSlots(analyzer.topBusySlots(10));
-
-    auto t1 = std::chrono::high_resolution_clock::now();
-    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count();
-
-    std::cout << "EXEC_MS\n" << ms << "\n";
-    return 0;
-}
+#include "analyzer.h"
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Usage: app [options] [file.csv ...]     (default file: SmallTrips.csv)
+//   --k N            entries per top query (10)
+//   --threads N      parallel or pipeline ingest threads, 0 = all cores (0)
+//   --mode M         sequential | parallel | pipeline (sequential, or
+//                    parallel when --threads other than 1 is given)
+//   --aggregation A  auto | per-thread | partitioned, for parallel (auto)
+//   --warmup N       untimed runs per file (0)
+//   --reps N         timed runs per file (1)
+//   --json           timings as JSON instead of the query results
+//   --trace FILE     write a Chrome trace of every run to FILE
+//
+// Without --json the output is the TOP_ZONES / TOP_SLOTS / EXEC_MS report of
+// the last run of each file.
+
+struct Options {
+    std::vector<std::string> files;
+    int k = 10;
+    IngestOptions ingest;
+    int warmup = 0;
+    int reps = 1;
+    bool json = false;
+    std::string trace;
+};
+
+// Milliseconds of each timed run of one file.
+struct FileTimings {
+    std::string path;
+    std::vector<double> ingestMs, queryMs, totalMs;
+    IngestStats stats;
+    MemoryUsage memory;
+};
+
+static void printZones(const std::vector<ZoneCount>& v) {
+    std::cout << "TOP_ZONES\n";
+    for (auto& x : v)
+        std::cout << x.zone << "," << x.count << "\n";
+}
+
+static void printSlots(const std::vector<SlotCount>& v) {
+    std::cout << "TOP_SLOTS\n";
+    for (auto& x : v)
+        std::cout << x.zone << "," << x.hour << "," << x.count << "\n";
+}
+
+static int usage(const std::string& error) {
+    std::cerr << "app: " << error << "\n"
+              << "usage: app [--k N] [--threads N] [--mode sequential|parallel|pipeline] "
+                 "[--aggregation auto|per-thread|partitioned]\n"
+                 "           [--warmup N] [--reps N] [--json] [--trace FILE] [file.csv ...]\n";
+    return 2;
+}
+
+static int parseCount(const std::string& flag, const std::string& value, int min) {
+    size_t used = 0;
+    int n = 0;
+    try {
+        n = std::stoi(value, &used);
+    } catch (const std::exception&) {
+        used = 0;
+    }
+    if (used == 0 || used != value.size() || n < min)
+        throw std::invalid_argument(flag + " expects an integer >= " + std::to_string(min));
+    return n;
+}
+
+static Options parseArgs(int argc, char** argv) {
+    Options o;
+    bool modeGiven = false, threadsGiven = false;
+    for (int i = 1; i < argc; ++i) {
+        const std::string a = argv[i];
+        if (a == "--json") {
+            o.json = true;
+            continue;
+        }
+        if (a.compare(0, 2, "--") != 0) {
+            o.files.push_back(a);
+            continue;
+        }
+        if (i + 1 >= argc)
+            throw std::invalid_argument(a + " needs a value");
+        const std::string v = argv[++i];
+
+        if (a == "--k") {
+            o.k = parseCount(a, v, 1);
+        } else if (a == "--threads") {
+            o.ingest.threads = parseCount(a, v, 0);
+            threadsGiven = true;
+        } else if (a == "--mode") {
+            modeGiven = true;
+            if (v == "sequential")
+                o.ingest.mode = IngestMode::Sequential;
+            else if (v == "parallel")
+                o.ingest.mode = IngestMode::Parallel;
+            else if (v == "pipeline")
+                o.ingest.mode = IngestMode::Pipeline;
+            else
+                throw std::invalid_argument("--mode expects sequential, parallel or pipeline");
+        } else if (a == "--aggregation") {
+            if (v == "auto")
+                o.ingest.aggregation = Aggregation::Auto;
+            else if (v == "per-thread")
+                o.ingest.aggregation = Aggregation::PerThread;
+            else if (v == "partitioned")
+                o.ingest.aggregation = Aggregation::Partitioned;
+            else
+                throw std::invalid_argument("--aggregation expects auto, per-thread or partitioned");
+        } else if (a == "--warmup") {
+            o.warmup = parseCount(a, v, 0);
+        } else if (a == "--reps") {
+            o.reps = parseCount(a, v, 1);
+        } else if (a == "--trace") {
+            o.trace = v;
+        } else {
+            throw std::invalid_argument("unknown option " + a);
+        }
+    }
+
+    // --threads alone asks for a parallel ingest
+    if (threadsGiven && !modeGiven && o.ingest.threads != 1)
+        o.ingest.mode = IngestMode::Parallel;
+    if (o.files.empty())
+        o.files.push_back("SmallTrips.csv");
+    return o;
+}
+
+static double msSince(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static std::string jsonString(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char)c < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+// min, median and nearest-rank p95 of a non-empty sample.
+static std::string jsonSummary(std::vector<double> ms) {
+    std::sort(ms.begin(), ms.end());
+    const size_t n = ms.size();
+    const double median = n % 2 ? ms[n / 2] : (ms[n / 2 - 1] + ms[n / 2]) / 2;
+    const double p95 = ms[(size_t)std::ceil(0.95 * n) - 1];
+
+    char buf[128];
+    std::snprintf(buf, sizeof(buf), "{\"min\": %.3f, \"median\": %.3f, \"p95\": %.3f}", ms[0], median, p95);
+    return buf;
+}
+
+static std::string jsonMemory(const MemoryUsage& mu) {
+    char buf[256];
+    std::snprintf(buf, sizeof(buf),
+                  "{\"zone_dictionary\": %lld, \"zone_counters\": %lld, \"slot_counters\": %lld, "
+                  "\"day_index\": %lld, \"filter\": %lld, \"total\": %lld, \"bytes_per_zone\": %.1f}",
+                  mu.zoneDictionary, mu.zoneCounters, mu.slotCounters, mu.dayIndex, mu.filter, mu.total,
+                  mu.bytesPerZone);
+    return buf;
+}
+
+static const char* modeName(IngestMode mode) {
+    switch (mode) {
+    case IngestMode::Parallel: return "parallel";
+    case IngestMode::Pipeline: return "pipeline";
+    default:                   return "sequential";
+    }
+}
+
+static const char* aggregationName(Aggregation a) {
+    switch (a) {
+    case Aggregation::PerThread:   return "per-thread";
+    case Aggregation::Partitioned: return "partitioned";
+    default:                       return "auto";
+    }
+}
+
+static void printJson(const Options& o, const std::vector<FileTimings>& files) {
+    std::cout << "{\n"
+              << "  \"config\": {\"k\": " << o.k
+              << ", \"mode\": \"" << modeName(o.ingest.mode)
+              << "\", \"aggregation\": \"" << aggregationName(o.ingest.aggregation)
+              << "\", \"threads\": " << o.ingest.threads
+              << ", \"warmup\": " << o.warmup << ", \"reps\": " << o.reps << "},\n"
+              << "  \"files\": [";
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        const FileTimings& f = files[i];
+        std::cout << (i ? ",\n" : "\n")
+                  << "    {\"path\": " << jsonString(f.path)
+                  << ", \"bytes\": " << f.stats.bytesRead
+                  << ", \"rows_seen\": " << f.stats.rowsSeen
+                  << ", \"rows_accepted\": " << f.stats.rowsAccepted
+                  << ", \"zones\": " << f.stats.zones << ",\n"
+                  << "     \"ingest_ms\": " << jsonSummary(f.ingestMs) << ",\n"
+                  << "     \"query_ms\": " << jsonSummary(f.queryMs) << ",\n"
+                  << "     \"total_ms\": " << jsonSummary(f.totalMs) << ",\n"
+                  << "     \"memory\": " << jsonMemory(f.memory) << "}";
+    }
+
+    std::cout << "\n  ],\n"
+              << "  \"peak_rss_kb\": " << peakRssKb() << "\n"
+              << "}\n";
+}
+
+int main(int argc, char** argv) {
+    Options o;
+    try {
+        o = parseArgs(argc, argv);
+    } catch (const std::invalid_argument& e) {
+        return usage(e.what());
+    }
+
+    if (!o.trace.empty()) {
+        startTrace();
+        traceThreadName("main");
+    }
+
+    std::vector<FileTimings> results;
+    for (const std::string& path : o.files) {
+        FileTimings ft;
+        ft.path = path;
+
+        for (int run = 0; run < o.warmup + o.reps; ++run) {
+            const auto t0 = std::chrono::steady_clock::now();
+
+            TripAnalyzer analyzer;
+            analyzer.setIngestOptions(o.ingest);
+            analyzer.ingestFile(path);
+            const double ingestMs = msSince(t0);
+
+            const auto t1 = std::chrono::steady_clock::now();
+            const auto zones = analyzer.topZones(o.k);
+            const auto slots = analyzer.topBusySlots(o.k);
+            const double queryMs = msSince(t1);
+
+            if (run < o.warmup)
+                continue;
+            ft.ingestMs.push_back(ingestMs);
+            ft.queryMs.push_back(queryMs);
+            ft.totalMs.push_back(ingestMs + queryMs);
+            ft.stats = analyzer.stats();
+            ft.memory = analyzer.memoryUsage();
+
+            if (!o.json && run == o.warmup + o.reps - 1) {
+                printZones(zones);
+                printSlots(slots);
+                std::cout << "EXEC_MS\n"
+                          << (long long)*std::min_element(ft.totalMs.begin(), ft.totalMs.end()) << "\n";
+            }
+        }
+        results.push_back(std::move(ft));
+    }
+
+    if (!o.trace.empty() && !stopTrace(o.trace)) {
+        std::cerr << "app: cannot write trace '" << o.trace << "'\n";
+        return 1;
+    }
+
+    if (o.json)
+        printJson(o, results);
+    return 0;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Heap footprint estimates for standard containers, for memoryUsage().
+// Allocator rounding and headers are not counted.
+
+
+// Bytes a string holds outside itself; zero while it fits the small-string buffer.
+inline size_t heapBytes(const std::string& s) {
+    const char* self = reinterpret_cast<const char*>(&s);
+    const bool inline_ = s.data() >= self && s.data() < self + sizeof(s);
+    return inline_ ? 0 : s.capacity() + 1;
+}
+
+
+template <class T>
+inline size_t vectorBytes(const std::vector<T>& v) {
+    return v.capacity() * sizeof(T);
+}
+
+
+// Node-based hash containers (unordered_map / unordered_set): the bucket
+// array plus one node per element holding a next pointer, the value and a
+// cached hash.
+template <class Table>
+inline size_t hashTableBytes(const Table& t) {
+    const size_t node = sizeof(void*) + sizeof(typename Table::value_type) + sizeof(size_t);
+    return t.bucket_count() * sizeof(void*) + t.size() * node;
+}
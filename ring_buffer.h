@@ -0,0 +1,129 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Bounded lock-free queues for handing work between the stages of a
+// pipelined ingest. Capacities round up to a power of two. tryPush fails
+// when the ring is full, which is the backpressure: the producer waits
+// instead of buffering without limit.
+
+
+// One producer thread, one consumer thread.
+template <class T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity) : cells(roundUp(capacity)), mask(cells.size() - 1) {}
+
+    bool tryPush(T&& v) {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == cells.size())
+            return false;
+        cells[t & mask] = std::move(v);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T& out) {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+        out = std::move(cells[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::vector<T> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head{0};      // next to pop; written by the consumer
+    alignas(64) std::atomic<size_t> tail{0};      // next to push; written by the producer
+
+    static size_t roundUp(size_t n) {
+        size_t cap = 2;
+        while (cap < n)
+            cap *= 2;
+        return cap;
+    }
+};
+
+
+// Any number of producer threads, one consumer thread. Every cell carries a
+// sequence number saying whose turn it is (Vyukov's bounded queue):
+// pos = free for the producer that claims slot pos, pos + 1 = filled for the
+// consumer. Producers claim a slot with one CAS on tail.
+template <class T>
+class MpscRing {
+public:
+    explicit MpscRing(size_t capacity) : cells(roundUp(capacity)), mask(cells.size() - 1) {
+        for (size_t i = 0; i < cells.size(); ++i)
+            cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    bool tryPush(T&& v) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& c = cells[pos & mask];
+            const intptr_t diff = (intptr_t)c.seq.load(std::memory_order_acquire) - (intptr_t)pos;
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;                           // a lap behind: full
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+        Cell& c = cells[pos & mask];
+        c.value = std::move(v);
+        c.seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T& out) {
+        Cell& c = cells[head & mask];
+        if (c.seq.load(std::memory_order_acquire) != head + 1)
+            return false;
+        out = std::move(c.value);
+        c.seq.store(head + cells.size(), std::memory_order_release);
+        ++head;
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        T value;
+    };
+
+    std::vector<Cell> cells;
+    size_t mask;
+    alignas(64) size_t head = 0;                  // consumer only
+    alignas(64) std::atomic<size_t> tail{0};
+
+    static size_t roundUp(size_t n) {
+        size_t cap = 2;
+        while (cap < n)
+            cap *= 2;
+        return cap;
+    }
+};
+
+
+// Retries op() until it succeeds or stop is raised; false if stopped. Spins
+// briefly, then yields so a waiting stage doesn't starve the one it waits on
+// when there are fewer cores than threads.
+template <class Op>
+bool waitFor(Op&& op, const std::atomic<bool>& stop) {
+    for (int tries = 0;; ++tries) {
+        if (op())
+            return true;
+        if (stop.load(std::memory_order_relaxed))
+            return false;
+        if (tries >= 64)
+            std::this_thread::yield();
+    }
+}
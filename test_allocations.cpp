@@ -0,0 +1,105 @@
+#include "analyzer.h"
+#include "catch_amalgamated.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <string>
+
+// Global operator new/delete are replaced for the whole test binary so that
+// a test can count the heap allocations made inside a block of code.
+// Counting is off unless a countAllocations() call is running.
+
+static std::atomic<bool> counting{false};
+static std::atomic<long long> allocations{0};
+
+static void* countedAlloc(std::size_t n) {
+    if (counting.load(std::memory_order_relaxed))
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(n ? n : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+static void* countedAlignedAlloc(std::size_t n, std::align_val_t al) {
+    if (counting.load(std::memory_order_relaxed))
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    const std::size_t a = static_cast<std::size_t>(al);
+    if (void* p = std::aligned_alloc(a, (n + a - 1) / a * a))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t n) { return countedAlloc(n); }
+void* operator new[](std::size_t n) { return countedAlloc(n); }
+void* operator new(std::size_t n, std::align_val_t a) { return countedAlignedAlloc(n, a); }
+void* operator new[](std::size_t n, std::align_val_t a) { return countedAlignedAlloc(n, a); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+template <class F>
+static long long countAllocations(F&& f) {
+    allocations = 0;
+    counting = true;
+    f();
+    counting = false;
+    return allocations;
+}
+
+// Every (zone, day) combination `repeat` times, at a time of day set by the
+// zone and day alone, so two files with different repeats hold exactly the
+// same distinct (zone, slot, day) keys.
+static void writeCycle(const std::string& path, int zones, int days, int repeat) {
+    std::ofstream out(path);
+    REQUIRE(out.is_open());
+    out << "TripID,PickupZoneID,DropoffZoneID,PickupDateTime,DistanceKm,FareAmount\n";
+
+    long long id = 1;
+    char buf[128];
+    for (int r = 0; r < repeat; ++r)
+        for (int d = 1; d <= days; ++d)
+            for (int z = 0; z < zones; ++z, ++id) {
+                // names past the 15-byte small-string limit
+                std::snprintf(buf, sizeof(buf), "%lld,PICKUP_ZONE_LONG_%05d,ZX,2024-05-%02d %02d:%02d,1.0,5.0\n",
+                              id, z, d, (z + d) % 24, z % 60);
+                out << buf;
+            }
+}
+
+// ------------------- M: memory behaviour -------------------
+
+TEST_CASE("M1", "[M][M1]") {
+    const std::string small = "m1_small.csv";
+    const std::string large = "m1_large.csv";
+
+    const int zones = 2000, days = 20;
+    writeCycle(small, zones, days, 2);      //  80k rows
+    writeCycle(large, zones, days, 10);     // 400k rows
+
+    TripAnalyzer ta;
+    ta.ingestFile(small);                   // settle one-time growth
+
+    const long long smallAllocs = countAllocations([&] { ta.ingestFile(small); });
+    const long long largeAllocs = countAllocations([&] { ta.ingestFile(large); });
+
+    INFO("small: " << smallAllocs << " allocations, large: " << largeAllocs);
+
+    // 5x the rows over the same keys must not mean more allocations
+    REQUIRE(largeAllocs <= smallAllocs + 64);
+
+    // and the base cost is a handful per distinct zone (table entry, name,
+    // day column growth), far below one per row
+    REQUIRE(smallAllocs <= 16LL * zones);
+    REQUIRE(ta.topZones(1)[0].count == 10LL * days);
+
+    std::remove(small.c_str());
+    std::remove(large.c_str());
+}
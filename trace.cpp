@@ -0,0 +1,162 @@
+#include "trace.h"
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+
+struct TraceEvent {
+    const char* name;
+    const char* cat;
+    int64_t startUs;
+    int64_t durUs;
+    const char* argName;
+    long long arg;
+};
+
+// One per recording thread; owned here so the events outlive the thread.
+// The owner appends under lock, which startTrace and stopTrace take to
+// clear and read it from their thread.
+struct TraceBuffer {
+    int tid;
+    bool owned = false;                  // by a live thread, else on freeBuffers
+    mutex lock;
+    const char* threadName = nullptr;
+    vector<TraceEvent> events;
+};
+
+static const size_t kBufferEvents = 1024;
+
+
+atomic<bool> gTraceOn{false};
+
+static mutex buffersMutex;               // buffers, freeBuffers and every owned flag
+static vector<unique_ptr<TraceBuffer>> buffers;
+static vector<TraceBuffer*> freeBuffers;
+// steady_clock ticks at startTrace; read by every recording thread
+static atomic<int64_t> traceStart{chrono::steady_clock::now().time_since_epoch().count()};
+
+
+// A buffer whose events stopTrace has written, else a new one. One still
+// holding events of an exited thread waits for stopTrace, so a track never
+// mixes two threads.
+static TraceBuffer* acquireBuffer() {
+    lock_guard<mutex> lock(buffersMutex);
+    for (size_t i = freeBuffers.size(); i-- > 0;) {
+        TraceBuffer* b = freeBuffers[i];
+        if (b->events.empty()) {
+            freeBuffers.erase(freeBuffers.begin() + i);
+            b->owned = true;
+            b->threadName = nullptr;
+            return b;
+        }
+    }
+    buffers.emplace_back(new TraceBuffer);
+    TraceBuffer* b = buffers.back().get();
+    b->tid = (int)buffers.size();
+    b->owned = true;
+    b->events.reserve(kBufferEvents);
+    return b;
+}
+
+
+// Hands the thread's buffer back to the free list as the thread exits.
+struct BufferOwner {
+    TraceBuffer* buffer = nullptr;
+
+    ~BufferOwner() {
+        if (!buffer)
+            return;
+        lock_guard<mutex> lock(buffersMutex);
+        buffer->owned = false;
+        freeBuffers.push_back(buffer);
+    }
+};
+
+static thread_local BufferOwner threadBuffer;
+
+
+static TraceBuffer& localBuffer() {
+    if (!threadBuffer.buffer)
+        threadBuffer.buffer = acquireBuffer();
+    return *threadBuffer.buffer;
+}
+
+
+int64_t traceNowUs() {
+    const chrono::steady_clock::duration start(traceStart.load(memory_order_relaxed));
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch() - start).count();
+}
+
+
+void traceComplete(const char* name, const char* cat, int64_t startUs, int64_t durUs,
+                   const char* argName, long long arg) {
+    TraceBuffer& b = localBuffer();
+    lock_guard<mutex> lock(b.lock);
+    b.events.push_back({name, cat, startUs, durUs, argName, arg});
+}
+
+
+void traceThreadName(const char* name) {
+    if (!gTraceOn.load(memory_order_relaxed))
+        return;
+    TraceBuffer& b = localBuffer();
+    lock_guard<mutex> lock(b.lock);
+    b.threadName = name;
+}
+
+
+void startTrace() {
+    lock_guard<mutex> lock(buffersMutex);
+    for (auto& b : buffers) {
+        lock_guard<mutex> bufferLock(b->lock);
+        b->events.clear();
+        b->threadName = nullptr;
+    }
+    traceStart.store(chrono::steady_clock::now().time_since_epoch().count(), memory_order_relaxed);
+    gTraceOn = true;
+}
+
+
+bool stopTrace(const string& path) {
+    gTraceOn = false;
+
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f)
+        return false;
+
+    lock_guard<mutex> lock(buffersMutex);
+    fputs("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n", f);
+    bool first = true;
+    for (const auto& b : buffers) {
+        lock_guard<mutex> bufferLock(b->lock);
+        if (b->events.empty() && !b->threadName)
+            continue;
+
+        char defaultName[32];
+        snprintf(defaultName, sizeof(defaultName), "thread %d", b->tid);
+        fprintf(f, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+                   "\"args\": {\"name\": \"%s\"}}",
+                first ? "" : ",\n", b->tid, b->threadName ? b->threadName : defaultName);
+        first = false;
+
+        for (const TraceEvent& e : b->events) {
+            fprintf(f, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+                       "\"ts\": %lld, \"dur\": %lld",
+                    e.name, e.cat, b->tid, (long long)e.startUs, (long long)e.durUs);
+            if (e.argName)
+                fprintf(f, ", \"args\": {\"%s\": %lld}", e.argName, e.arg);
+            fputs("}", f);
+        }
+        b->events.clear();
+        // a free buffer that grew keeps only the usual reserve
+        if (!b->owned && b->events.capacity() > kBufferEvents) {
+            vector<TraceEvent>().swap(b->events);
+            b->events.reserve(kBufferEvents);
+        }
+    }
+    fputs("\n]}\n", f);
+    return fclose(f) == 0;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Chrome trace_event recording (chrome://tracing, ui.perfetto.dev) of ingest
+// blocks, parallel workers, merges and top* queries of every TripAnalyzer.
+// Each thread appends to its own buffer under that buffer's lock, which only
+// startTrace and stopTrace contend for; while tracing is off a scope costs one
+// relaxed load. A thread's buffer goes back to a free list when it exits.
+//
+// startTrace and stopTrace may run while other threads record; a scope still
+// open when stopTrace runs is left out of the file.
+
+// Discards anything recorded so far and starts recording.
+void startTrace();
+
+// Stops recording and writes (and drops) the events as trace JSON; false if
+// path can't be written.
+bool stopTrace(const std::string& path);
+
+// Names the calling thread in the trace (by default "thread N").
+void traceThreadName(const char* name);
+
+
+extern std::atomic<bool> gTraceOn;
+
+// Records one complete ("X") event. name, cat and argName must be string literals.
+void traceComplete(const char* name, const char* cat, int64_t startUs, int64_t durUs,
+                   const char* argName, long long arg);
+
+int64_t traceNowUs();
+
+// Times its lifetime as one trace event, with an optional numeric argument.
+class TraceScope {
+public:
+    TraceScope(const char* name, const char* cat)
+        : name(name), cat(cat), on(gTraceOn.load(std::memory_order_relaxed)) {
+        if (on)
+            t0 = traceNowUs();
+    }
+    ~TraceScope() {
+        if (on)
+            traceComplete(name, cat, t0, traceNowUs() - t0, argName, arg);
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    void setArg(const char* key, long long value) {
+        argName = key;
+        arg = value;
+    }
+
+private:
+    const char* name;
+    const char* cat;
+    const char* argName = nullptr;
+    long long arg = 0;
+    bool on;
+    int64_t t0 = 0;
+};
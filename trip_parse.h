@@ -0,0 +1,296 @@
+#pragma once
+#include "day_series.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Byte-level parsing of trip rows. Everything here works on views into the
+// read buffer, so a rejected row never costs an allocation.
+
+
+inline bool isDigit(char c) {
+    return (unsigned)(c - '0') < 10;
+}
+
+
+inline std::string_view trimmed(const char* b, const char* e) {
+    while (b < e && isspace((unsigned char)*b)) b++;
+    while (e > b && isspace((unsigned char)e[-1])) e--;
+    return std::string_view(b, e - b);
+}
+
+
+// The two columns a row contributes, trimmed, as views into the line.
+struct RawRow {
+    std::string_view zone;
+    std::string_view timestamp;
+};
+
+
+// TripID,PickupZoneID,DropoffZoneID,PickupDateTime,DistanceKm,FareAmount:
+// a row needs all six columns (extra ones are ignored), like reading them
+// with getline(ss, field, ',') one after another.
+inline bool splitRow(const char* b, const char* e, RawRow& row) {
+    const char* comma[5];
+    const char* p = b;
+    for (int i = 0; i < 5; ++i) {
+        comma[i] = (const char*)memchr(p, ',', e - p);
+        if (!comma[i])
+            return false;
+        p = comma[i] + 1;
+    }
+    if (p == e)
+        return false;
+
+    row.zone = trimmed(comma[0] + 1, comma[1]);
+    row.timestamp = trimmed(comma[2] + 1, comma[3]);
+    return true;
+}
+
+
+// Days since 0000-03-01 (proleptic Gregorian). Starting the year in March
+// puts the leap day last, so the day-of-year is a closed form in the month.
+inline int daysFromCivil(int y, int m, int d) {
+    y -= m <= 2;
+    const int era = y / 400;
+    const int yoe = y - era * 400;
+    const int doy = (153 * ((m + 9) % 12) + 2) / 5 + d - 1;
+    const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe;
+}
+
+
+const int kEpochDays = 719468;    // daysFromCivil(1970, 1, 1)
+
+
+// Inverse of daysFromCivil, formatted as YYYY-MM-DD.
+inline std::string formatDay(DayCode day) {
+    const int z = day + kEpochDays;
+    const int era = z / 146097;
+    const int doe = z - era * 146097;
+    const int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const int mp = (5 * doy + 2) / 153;
+    const int d = doy - (153 * mp + 2) / 5 + 1;
+    const int m = mp < 10 ? mp + 3 : mp - 9;
+    const int y = yoe + era * 400 + (m <= 2);
+
+    const char buf[] = {
+        char('0' + y / 1000), char('0' + y / 100 % 10), char('0' + y / 10 % 10), char('0' + y % 10), '-',
+        char('0' + m / 10), char('0' + m % 10), '-',
+        char('0' + d / 10), char('0' + d % 10)
+    };
+    return std::string(buf, sizeof(buf));
+}
+
+
+// Of a day counted from 1970-01-01, a Thursday; returns 0–6 with Monday = 0.
+inline int weekdayFromDays(int days) {
+    return ((days + 3) % 7 + 7) % 7;
+}
+
+
+// Parses the "YYYY-MM-DD" prefix of a pickup timestamp into days since
+// 1970-01-01, for any year from 0001 to 9999.
+inline bool parseDate(std::string_view s, int& days) {
+    if (s.size() < 10 || s[4] != '-' || s[7] != '-')
+        return false;
+    static const int pos[] = {0, 1, 2, 3, 5, 6, 8, 9};
+    for (int p : pos)
+        if (!isDigit(s[p]))
+            return false;
+
+    const int y = (s[0] - '0') * 1000 + (s[1] - '0') * 100 + (s[2] - '0') * 10 + (s[3] - '0');
+    const int m = (s[5] - '0') * 10 + (s[6] - '0');
+    const int d = (s[8] - '0') * 10 + (s[9] - '0');
+    if (y < 1 || m < 1 || m > 12 || d < 1)
+        return false;
+
+    static const int monthDays[] = {0, 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    const bool leap = (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+    if (d > monthDays[m] + (m == 2 && leap))
+        return false;
+
+    days = daysFromCivil(y, m, d) - kEpochDays;
+    return true;
+}
+
+
+// The day code of a day count; kNoDay outside what a DayCode holds.
+inline DayCode dayCode(int days) {
+    return days >= 0 && days < kNoDay ? (DayCode)days : kNoDay;
+}
+
+
+// A date the day series can hold, as a day code.
+inline bool parseDay(std::string_view s, DayCode& day) {
+    int days;
+    if (!parseDate(s, days) || dayCode(days) == kNoDay)
+        return false;
+    day = (DayCode)days;
+    return true;
+}
+
+
+// Splits the trailing "HH:MM" of a pickup timestamp; the range is checked
+// by parseTimestamp. A one-digit hour after a space counts too, as the
+// original parser's stoi read it: "2024-01-01 9:15" is hour 9.
+inline bool parseTime(std::string_view s, int& hour, int& minute) {
+    if (s.size() < 5)
+        return false;
+    const char* t = s.data() + s.size() - 5;
+    if (!isDigit(t[1]) || t[2] != ':' || !isDigit(t[3]) || !isDigit(t[4]))
+        return false;
+    if (isDigit(t[0]))
+        hour = (t[0] - '0') * 10 + (t[1] - '0');
+    else if (isspace((unsigned char)t[0]))
+        hour = t[1] - '0';
+    else
+        return false;
+    minute = (t[3] - '0') * 10 + (t[4] - '0');
+    return true;
+}
+
+
+// Why a row was not counted.
+enum class RowError {
+    None,
+    MissingColumn,
+    EmptyZone,
+    BadTimestamp,     // no "HH:MM" at the end
+    BadHour           // well-formed, but the hour or minute is out of range
+};
+
+
+// A row is counted by its time of day alone; the date only adds the weekday
+// and day dimensions, so a row whose date doesn't parse is still counted,
+// with dated = false. A date outside the DayCode range keeps its weekday
+// and gets day = kNoDay.
+struct Timestamp {
+    bool dated;
+    int days;
+    DayCode day;
+    int hour;
+    int minute;
+};
+
+
+inline RowError parseTimestamp(std::string_view s, Timestamp& ts) {
+    if (!parseTime(s, ts.hour, ts.minute))
+        return RowError::BadTimestamp;
+    if (ts.hour > 23 || ts.minute > 59)
+        return RowError::BadHour;
+    ts.dated = parseDate(s, ts.days);
+    ts.day = ts.dated ? dayCode(ts.days) : kNoDay;
+    return RowError::None;
+}
+
+
+// Calls f(begin, end) for each line of a block, without the '\n' and one
+// trailing '\r'. The last line may be unterminated.
+template <class F>
+inline void forEachLine(const char* b, const char* e, F&& f) {
+    while (b < e) {
+        const char* nl = (const char*)memchr(b, '\n', e - b);
+        const char* end = nl ? nl : e;
+        f(b, end > b && end[-1] == '\r' ? end - 1 : end);
+        b = end + 1;
+    }
+}
+
+
+// Reads a stream in large blocks instead of one getline per row, handing
+// out either single lines (next) or whole runs of complete lines
+// (nextBlock). The '\n' and one trailing '\r' of a line are stripped; a
+// line longer than the buffer grows it.
+class LineReader {
+public:
+    // Reads at most `limit` bytes of in, from its current position.
+    explicit LineReader(std::istream& in, size_t blockSize = 1 << 20, size_t limit = SIZE_MAX)
+        : in(in), buf(blockSize), left(limit) {}
+
+    // Every complete line currently buffered (plus the unterminated tail at
+    // end of input), valid until the next call.
+    bool nextBlock(const char*& b, const char*& e) {
+        for (;;) {
+            const char* p = buf.data() + pos;
+            const char* lim = buf.data() + have;
+            const char* last = lim;
+            while (last > p && last[-1] != '\n')
+                last--;
+            if (last > p || (eof && p < lim)) {
+                b = p;
+                e = last > p ? last : lim;
+                pos = e - buf.data();
+                return true;
+            }
+            if (eof)
+                return false;
+            refill();
+        }
+    }
+
+    bool next(const char*& b, const char*& e) {
+        for (;;) {
+            const char* p = buf.data() + pos;
+            const char* lim = buf.data() + have;
+            const char* nl = (const char*)memchr(p, '\n', lim - p);
+            if (nl || (eof && p < lim)) {
+                b = p;
+                e = nl ? nl : lim;
+                pos = (nl ? nl + 1 : lim) - buf.data();
+                if (e > b && e[-1] == '\r')
+                    e--;
+                return true;
+            }
+            if (eof)
+                return false;
+            refill();
+        }
+    }
+
+    // Goes on from the stream's current position with a new byte limit,
+    // dropping anything still buffered; totals and the buffer carry over.
+    void restart(size_t limit) {
+        pos = have = 0;
+        left = limit;
+        eof = false;
+    }
+
+    size_t bytesRead() const { return total; }
+
+    // Time spent inside reads.
+    double readSeconds() const { return std::chrono::duration<double>(readTime).count(); }
+
+private:
+    std::istream& in;
+    std::vector<char> buf;
+    size_t pos = 0, have = 0, total = 0;
+    size_t left;
+    bool eof = false;
+    std::chrono::steady_clock::duration readTime{};
+
+    void refill() {
+        const auto t0 = std::chrono::steady_clock::now();
+        memmove(buf.data(), buf.data() + pos, have - pos);
+        have -= pos;
+        pos = 0;
+        if (have == buf.size())
+            buf.resize(buf.size() * 2);
+
+        in.read(buf.data() + have, std::min(buf.size() - have, left));
+        const size_t got = (size_t)in.gcount();
+        have += got;
+        total += got;
+        left -= got;
+        eof = got == 0;
+        readTime += std::chrono::steady_clock::now() - t0;
+    }
+};
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs task(worker, item) for every item in [0, items) on `workers` threads,
+// the calling thread being worker 0. Each worker starts with a contiguous
+// run of items in its own deque and takes from the front; once that is
+// empty it steals from the back of the others', so everyone stays busy
+// until the last item is taken even when items differ a lot in cost.
+//
+// Items are meant to be coarse (a morsel of a file), so each deque has a
+// plain mutex: a lock per item is noise next to the item itself.
+//
+// An exception from a task stops that worker; the first one is rethrown
+// after every thread has joined.
+template <class Task>
+void runStealing(int workers, size_t items, Task&& task) {
+    struct Queue {
+        std::mutex m;
+        std::deque<size_t> items;
+    };
+    std::vector<Queue> queues(workers);
+    for (int w = 0; w < workers; ++w)
+        for (size_t i = items * w / workers; i < items * (w + 1) / workers; ++i)
+            queues[w].items.push_back(i);
+
+    auto take = [&](int w, size_t& item) {
+        for (int k = 0; k < workers; ++k) {
+            Queue& q = queues[(w + k) % workers];
+            std::lock_guard<std::mutex> lock(q.m);
+            if (q.items.empty())
+                continue;
+            if (k == 0) {
+                item = q.items.front();
+                q.items.pop_front();
+            } else {
+                item = q.items.back();
+                q.items.pop_back();
+            }
+            return true;
+        }
+        return false;
+    };
+
+    std::vector<std::exception_ptr> errors(workers);
+    auto run = [&](int w) {
+        try {
+            size_t item;
+            while (take(w, item))
+                task(w, item);
+        } catch (...) {
+            errors[w] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int w = 1; w < workers; ++w)
+        threads.emplace_back(run, w);
+    run(0);
+    for (std::thread& t : threads)
+        t.join();
+
+    for (const std::exception_ptr& err : errors)
+        if (err)
+            std::rethrow_exception(err);
+}
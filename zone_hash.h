@@ -0,0 +1,65 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Seeded 64-bit hash for short byte strings (wyhash construction: 4- and
+// 8-byte loads folded with 64x64->128 bit multiplies). Zone IDs are a
+// handful of bytes, so most keys hash with two loads and two multiplies.
+
+
+inline uint64_t hashMix(uint64_t a, uint64_t b) {
+    const __uint128_t r = (__uint128_t)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+
+inline uint64_t load64(const char* p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+
+inline uint64_t load32(const char* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+
+inline uint64_t hashBytes(const char* p, size_t n, uint64_t seed) {
+    const uint64_t k0 = 0xa0761d6478bd642full;
+    const uint64_t k1 = 0xe7037ed1a0b428dbull;
+    const uint64_t k2 = 0x8ebc6af09c88c6e3ull;
+
+    seed ^= hashMix(seed ^ k0, k1);
+    uint64_t a, b;
+    if (n <= 16) {
+        if (n >= 4) {
+            const size_t q = (n >> 3) << 2;
+            a = (load32(p) << 32) | load32(p + q);
+            b = (load32(p + n - 4) << 32) | load32(p + n - 4 - q);
+        } else if (n > 0) {
+            a = ((uint64_t)(unsigned char)p[0] << 16) | ((uint64_t)(unsigned char)p[n >> 1] << 8) |
+                (unsigned char)p[n - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = n;
+        while (i > 16) {
+            seed = hashMix(load64(p) ^ k1, load64(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        // the last 16 bytes, overlapping the previous block when i < 16
+        a = load64(p + i - 16);
+        b = load64(p + i - 8);
+    }
+
+    a ^= k1;
+    b ^= seed;
+    return hashMix(k2 ^ n, hashMix(a, b) ^ k1);
+}
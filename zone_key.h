@@ -0,0 +1,72 @@
+#pragma once
+#include "zone_hash.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "ZoneKey packs bytes little-endian");
+
+// A zone ID as the zone table keeps it. Almost every ID is at most 16
+// bytes: those sit inline in two words, zero padded, so equality is three
+// integer compares and ordering two byte swaps. A longer ID keeps its first
+// 8 bytes in lo, which settles most comparisons, and points at its bytes
+// with hi.
+struct ZoneKey {
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+    uint32_t len = 0;
+
+    static const size_t kInline = 16;
+
+    // Packs s without reading past its end. A long key points into s.
+    static ZoneKey of(std::string_view s) {
+        ZoneKey k;
+        const size_t n = s.size();
+        const char* p = s.data();
+        k.len = (uint32_t)n;
+        if (n > kInline) {
+            k.lo = load64(p);
+            k.hi = (uintptr_t)p;
+        } else if (n >= 8) {
+            k.lo = load64(p);
+            if (n > 8)
+                k.hi = load64(p + n - 8) >> (8 * (16 - n));
+        } else if (n >= 4) {
+            k.lo = load32(p) | (load32(p + n - 4) >> (8 * (8 - n))) << 32;
+        } else {
+            for (size_t i = 0; i < n; ++i)
+                k.lo |= (uint64_t)(uint8_t)p[i] << (8 * i);
+        }
+        return k;
+    }
+
+    bool isInline() const { return len <= kInline; }
+
+    // The bytes; an inline key views itself, so the view lives as long as
+    // this copy of the key does.
+    std::string_view view() const {
+        return isInline() ? std::string_view((const char*)&lo, len) : std::string_view((const char*)hi, len);
+    }
+
+    friend bool operator==(const ZoneKey& a, const ZoneKey& b) {
+        if (a.len != b.len || a.lo != b.lo)
+            return false;
+        return a.isInline() ? a.hi == b.hi : memcmp((const char*)a.hi, (const char*)b.hi, a.len) == 0;
+    }
+
+    // Byte order, as std::string compares. Zero padding orders a key
+    // before any longer key it is a prefix of.
+    friend bool operator<(const ZoneKey& a, const ZoneKey& b) {
+        if (a.lo != b.lo)
+            return __builtin_bswap64(a.lo) < __builtin_bswap64(b.lo);
+        if (a.isInline() && b.isInline()) {
+            if (a.hi != b.hi)
+                return __builtin_bswap64(a.hi) < __builtin_bswap64(b.hi);
+            return a.len < b.len;
+        }
+        return a.view() < b.view();
+    }
+};
+
+static_assert(offsetof(ZoneKey, hi) == 8, "inline bytes must be contiguous");
@@ -0,0 +1,168 @@
+#pragma once
+#include "byte_arena.h"
+#include "memory_size.h"
+#include "zone_hash.h"
+#include "zone_key.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Zone name -> dense id, ids in first-seen order. Open addressing with
+// linear probing over a power-of-two array of (hash tag, id) slots kept at
+// most 3/4 full, so a lookup usually touches one cache line and compares
+// one key. Keys are ZoneKeys in id order: IDs of up to 16 bytes inline,
+// hashed and compared as two words; longer ones point into an arena where
+// their bytes sit back to back, so there is no allocation per zone either
+// way.
+//
+// Zone IDs come from the input and may be crafted. std::hash<std::string>
+// is unseeded, so keys that all collide can be computed offline and turn a
+// chained table into linear scans; here every table draws its own hash seed
+// from std::random_device.
+class ZoneTable {
+public:
+    ZoneTable() {
+        std::random_device rd;
+        seed = ((uint64_t)rd() << 32) ^ rd();
+        seedHi = ((uint64_t)rd() << 32) ^ rd();
+    }
+
+    // Drops every zone, keeping the slot array.
+    void clear() {
+        std::fill(slots.begin(), slots.end(), Slot());
+        keys.clear();
+        names.clear();
+        growths = 0;
+    }
+
+    void reserve(size_t zones) {
+        keys.reserve(zones);
+        if (zones * 4 > slots.size() * 3)
+            rehash(zones);
+    }
+
+    size_t size() const { return keys.size(); }
+    size_t capacity() const { return slots.size(); }
+
+    // Rehashes forced by inserts since clear(), i.e. not asked for by reserve().
+    size_t rehashes() const { return growths; }
+
+    // This table's random seed, for hashes derived from it.
+    uint64_t hashSeed() const { return seed; }
+
+    // A copy: an inline key's bytes live in keys, which an insert may move.
+    std::string key(uint32_t id) const { return std::string(keys[id].view()); }
+    const ZoneKey& packed(uint32_t id) const { return keys[id]; }
+
+    uint64_t hash(const ZoneKey& k) const {
+        if (!k.isInline())
+            return hashBytes((const char*)k.hi, k.len, seed);
+        return hashMix(hashMix(k.lo ^ seed, k.hi ^ seedHi) ^ k.len, 0x8ebc6af09c88c6e3ull);
+    }
+
+    // Starts loading the home slot of a hash, for a lookup a little later.
+    void prefetch(uint64_t h) const {
+        if (!slots.empty())
+            __builtin_prefetch(&slots[h & mask]);
+    }
+
+    bool find(std::string_view zone, uint32_t& id) const {
+        if (slots.empty())
+            return false;
+        const ZoneKey k = ZoneKey::of(zone);
+        const uint64_t h = hash(k);
+        for (size_t i = h & mask;; i = (i + 1) & mask) {
+            const Slot& s = slots[i];
+            if (s.id == 0)
+                return false;
+            if (s.tag == (uint32_t)(h >> 32) && keys[s.id - 1] == k) {
+                id = s.id - 1;
+                return true;
+            }
+        }
+    }
+
+    // Id of k, adding it (as the next id) if new.
+    // A long k is copied in when added, so it need only outlive the call.
+    uint32_t insert(const ZoneKey& k, bool& added) { return insert(k, hash(k), added); }
+
+    // Same, with h = hash(k) computed beforehand.
+    uint32_t insert(const ZoneKey& k, uint64_t h, bool& added) {
+        if ((keys.size() + 1) * 4 > slots.size() * 3) {
+            rehash(keys.size() + 1);
+            ++growths;
+        }
+
+        const uint32_t tag = (uint32_t)(h >> 32);
+        size_t i = h & mask;
+        for (;; i = (i + 1) & mask) {
+            const Slot& s = slots[i];
+            if (s.id == 0)
+                break;
+            if (s.tag == tag && keys[s.id - 1] == k) {
+                added = false;
+                return s.id - 1;
+            }
+        }
+
+        keys.push_back(k);
+        if (!k.isInline())
+            keys.back().hi = (uintptr_t)names.copy(k.view()).data();
+        slots[i] = {tag, (uint32_t)keys.size()};
+        added = true;
+        return (uint32_t)keys.size() - 1;
+    }
+
+    // Slots a hit inspects: mean over all keys, and the worst.
+    void probeStats(double& avg, long long& longest) const {
+        long long total = 0;
+        longest = 0;
+        for (size_t i = 0; i < slots.size(); ++i) {
+            if (slots[i].id == 0)
+                continue;
+            const uint32_t id = slots[i].id - 1;
+            const size_t home = hash(keys[id]) & mask;
+            const long long probes = (long long)((i - home) & mask) + 1;
+            total += probes;
+            longest = std::max(longest, probes);
+        }
+        avg = keys.empty() ? 0 : (double)total / keys.size();
+    }
+
+    size_t bytes() const {
+        return vectorBytes(slots) + vectorBytes(keys) + names.bytes();
+    }
+
+private:
+    struct Slot {
+        uint32_t tag = 0;             // high half of the hash
+        uint32_t id = 0;              // id + 1; 0 = empty
+    };
+
+    std::vector<Slot> slots;
+    size_t mask = 0;
+    std::vector<ZoneKey> keys;
+    ByteArena names;                      // bytes of the keys too long to inline
+    uint64_t seed, seedHi;
+    size_t growths = 0;
+
+    void rehash(size_t zones) {
+        size_t cap = 16;
+        while (zones * 4 > cap * 3)
+            cap *= 2;
+
+        slots.assign(cap, Slot());
+        mask = cap - 1;
+        for (uint32_t id = 0; id < keys.size(); ++id) {
+            const uint64_t h = hash(keys[id]);
+            size_t i = h & mask;
+            while (slots[i].id != 0)
+                i = (i + 1) & mask;
+            slots[i] = {(uint32_t)(h >> 32), id + 1};
+        }
+    }
+};